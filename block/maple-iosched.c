@@ -10,6 +10,11 @@
  * handling to allow for read biases. By prioritizing reads, simple tasks should improve
  * in performance. Maple also uses hooks for the powersuspend driver to increase
  * expirations when power is suspended to decrease workload.
+ *
+ * Requests can optionally be split into system, foreground and background
+ * classes by ioprio and blkio cgroup. Each class has its own fifos and the
+ * classes are served by weight, so a background writer cannot hold back the
+ * sync reads of the foreground app until its requests expire.
  */
 #include <linux/blkdev.h>
 #include <linux/elevator.h>
@@ -18,11 +23,17 @@
 #include <linux/init.h>
 #include <linux/slab.h>
 #include <linux/display_state.h>
+#include <linux/ioprio.h>
+#include <linux/iocontext.h>
+#include "blk-cgroup.h"
 
-#define MAPLE_IOSCHED_PATCHLEVEL	(8)
+#define MAPLE_IOSCHED_PATCHLEVEL	(9)
 
 enum { ASYNC, SYNC };
 
+/* Request classes, in the order they are preferred */
+enum { SYS_CLASS, FG_CLASS, BG_CLASS, MAPLE_NR_CLASSES };
+
 /* Tunables */
 static const int sync_read_expire = 100;	/* max time before a read sync is submitted. */
 static const int sync_write_expire = 350;	/* max time before a write sync is submitted. */
@@ -31,21 +42,28 @@ static const int async_write_expire = 500;	/* ditto for write async, these limit
 static const int fifo_batch = 16;		/* # of sequential requests treated as one by the above parameters. */
 static const int writes_starved = 3;		/* max times reads can starve a write */
 static const int sleep_latency_multiple = 5;	/* multple for expire time when device is asleep */
+static const int class_enabled = 1;		/* split requests into system/foreground/background classes */
+static const int sys_weight = 4;		/* requests dispatched from a class per round */
+static const int fg_weight = 8;
+static const int bg_weight = 1;
 
 /* Elevator data */
 struct maple_data {
 	/* Request queues */
-	struct list_head fifo_list[2][2];
+	struct list_head fifo_list[MAPLE_NR_CLASSES][2][2];
 
 	/* Attributes */
 	unsigned int batched;
 	unsigned int starved;
+	int credit[MAPLE_NR_CLASSES];
 
 	/* Settings */
 	int fifo_expire[2][2];
 	int fifo_batch;
 	int writes_starved;
   int sleep_latency_multiple;
+	int class_enabled;
+	int class_weight[MAPLE_NR_CLASSES];
 };
 
 static inline struct maple_data *
@@ -53,6 +71,112 @@ maple_get_data(struct request_queue *q) {
 	return q->elevator->elevator_data;
 }
 
+/* The class of a queued request is kept in its elevator private data */
+static inline int
+maple_rq_class(struct request *rq)
+{
+	return (long)rq->elv.priv[0];
+}
+
+static inline void
+maple_set_rq_class(struct request *rq, int class)
+{
+	rq->elv.priv[0] = (void *)(long)class;
+}
+
+#ifdef CONFIG_BLK_CGROUP
+/* Tasks moved to a blkio group weighted below the default are background */
+static bool
+maple_blkcg_background(struct request *rq)
+{
+	struct blkcg *blkcg;
+	bool bg;
+
+	rcu_read_lock();
+	blkcg = bio_blkcg(rq->bio);
+	bg = blkcg != &blkcg_root && blkcg->cfq_weight < CFQ_WEIGHT_DEFAULT;
+	rcu_read_unlock();
+
+	return bg;
+}
+#else
+static inline bool
+maple_blkcg_background(struct request *rq)
+{
+	return false;
+}
+#endif
+
+static int
+maple_classify(struct maple_data *mdata, struct request *rq)
+{
+	int ioprio = req_get_ioprio(rq);
+
+	if (!mdata->class_enabled)
+		return FG_CLASS;
+
+	/* Fall back to the priority of the submitting task */
+	if (!ioprio_valid(ioprio) && current->io_context)
+		ioprio = current->io_context->ioprio;
+
+	switch (IOPRIO_PRIO_CLASS(ioprio)) {
+	case IOPRIO_CLASS_RT:
+		return SYS_CLASS;
+	case IOPRIO_CLASS_IDLE:
+		return BG_CLASS;
+	}
+
+	/* Filesystem metadata blocks everybody */
+	if (rq->cmd_flags & (REQ_META | REQ_PRIO))
+		return SYS_CLASS;
+
+	if (maple_blkcg_background(rq))
+		return BG_CLASS;
+
+	/* Async writes are flusher writeback on behalf of somebody else */
+	if (!rq_is_sync(rq) && rq_data_dir(rq) == WRITE)
+		return BG_CLASS;
+
+	return FG_CLASS;
+}
+
+static bool
+maple_class_empty(struct maple_data *mdata, int class)
+{
+	struct list_head (*fifo)[2] = mdata->fifo_list[class];
+
+	return list_empty(&fifo[SYNC][READ]) && list_empty(&fifo[SYNC][WRITE]) &&
+		list_empty(&fifo[ASYNC][READ]) && list_empty(&fifo[ASYNC][WRITE]);
+}
+
+/*
+ * Pick the class to dispatch from. Every class may dispatch as many
+ * requests per round as its weight, a new round starts once all classes
+ * with pending requests have used up their credit.
+ */
+static int
+maple_choose_class(struct maple_data *mdata)
+{
+	int class, first = -1;
+
+	for (class = 0; class < MAPLE_NR_CLASSES; class++) {
+		if (maple_class_empty(mdata, class))
+			continue;
+		if (mdata->credit[class] > 0)
+			return class;
+		if (first < 0)
+			first = class;
+	}
+
+	if (first < 0)
+		return -1;
+
+	for (class = 0; class < MAPLE_NR_CLASSES; class++)
+		mdata->credit[class] = mdata->class_weight[class];
+
+	return first;
+}
+
 static void
 maple_merged_requests(struct request_queue *q, struct request *rq,
 		    struct request *next)
@@ -65,6 +189,7 @@ maple_merged_requests(struct request_queue *q, struct request *rq,
 		if (time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
 			list_move(&rq->queuelist, &next->queuelist);
 			rq_set_fifo_time(rq, rq_fifo_time(next));
+			maple_set_rq_class(rq, maple_rq_class(next));
 		}
 	}
 
@@ -79,27 +204,31 @@ maple_add_request(struct request_queue *q, struct request *rq)
 	const int sync = rq_is_sync(rq);
 	const int dir = rq_data_dir(rq);
 	const bool display_on = is_display_on();
+	const int class = maple_classify(mdata, rq);
+	struct list_head *fifo = &mdata->fifo_list[class][sync][dir];
+	/* inrease expiration when device is asleep */
+	unsigned int fifo_expire_suspended = mdata->fifo_expire[sync][dir] * sleep_latency_multiple;
 
 	/*
 	 * Add request to the proper fifo list and set its
 	 * expire time.
 	 */
-
-   	/* inrease expiration when device is asleep */
-   	unsigned int fifo_expire_suspended = mdata->fifo_expire[sync][dir] * sleep_latency_multiple;
-   	if (display_on && mdata->fifo_expire[sync][dir]) {
-   		rq_set_fifo_time(rq, jiffies + mdata->fifo_expire[sync][dir]);
-   		list_add_tail(&rq->queuelist, &mdata->fifo_list[sync][dir]);
-   	} else if (!display_on && fifo_expire_suspended) {
-   		rq_set_fifo_time(rq, jiffies + fifo_expire_suspended);
-   		list_add_tail(&rq->queuelist, &mdata->fifo_list[sync][dir]);
-   	}
+	maple_set_rq_class(rq, class);
+
+	if (display_on && mdata->fifo_expire[sync][dir]) {
+		rq_set_fifo_time(rq, jiffies + mdata->fifo_expire[sync][dir]);
+		list_add_tail(&rq->queuelist, fifo);
+	} else if (!display_on && fifo_expire_suspended) {
+		rq_set_fifo_time(rq, jiffies + fifo_expire_suspended);
+		list_add_tail(&rq->queuelist, fifo);
+	}
 }
 
 static struct request *
-maple_expired_request(struct maple_data *mdata, int sync, int data_dir)
+maple_expired_request(struct maple_data *mdata, int class, int sync,
+		      int data_dir)
 {
-	struct list_head *list = &mdata->fifo_list[sync][data_dir];
+	struct list_head *list = &mdata->fifo_list[class][sync][data_dir];
 	struct request *rq;
 
 	if (list_empty(list))
@@ -116,12 +245,12 @@ maple_expired_request(struct maple_data *mdata, int sync, int data_dir)
 }
 
 static struct request *
-maple_choose_expired_request(struct maple_data *mdata)
+maple_choose_expired_request(struct maple_data *mdata, int class)
 {
-	struct request *rq_sync_read = maple_expired_request(mdata, SYNC, READ);
-	struct request *rq_sync_write = maple_expired_request(mdata, SYNC, WRITE);
-	struct request *rq_async_read = maple_expired_request(mdata, ASYNC, READ);
-	struct request *rq_async_write = maple_expired_request(mdata, ASYNC, WRITE);
+	struct request *rq_sync_read = maple_expired_request(mdata, class, SYNC, READ);
+	struct request *rq_sync_write = maple_expired_request(mdata, class, SYNC, WRITE);
+	struct request *rq_async_read = maple_expired_request(mdata, class, ASYNC, READ);
+	struct request *rq_async_write = maple_expired_request(mdata, class, ASYNC, WRITE);
 
 	/* Reset (non-expired-)batch-counter */
 	mdata->batched = 0;
@@ -154,10 +283,10 @@ maple_choose_expired_request(struct maple_data *mdata)
 }
 
 static struct request *
-maple_choose_request(struct maple_data *mdata, int data_dir)
+maple_choose_request(struct maple_data *mdata, int class, int data_dir)
 {
-	struct list_head *sync = mdata->fifo_list[SYNC];
-	struct list_head *async = mdata->fifo_list[ASYNC];
+	struct list_head *sync = mdata->fifo_list[class][SYNC];
+	struct list_head *async = mdata->fifo_list[class][ASYNC];
 
 	/* Increase (non-expired-)batch-counter */
 	mdata->batched++;
@@ -184,18 +313,21 @@ maple_choose_request(struct maple_data *mdata, int data_dir)
 static inline void
 maple_dispatch_request(struct maple_data *mdata, struct request *rq)
 {
+	const int class = maple_rq_class(rq);
+
 	/*
 	 * Remove the request from the fifo list
 	 * and dispatch it.
 	 */
 	rq_fifo_clear(rq);
 	elv_dispatch_add_tail(rq->q, rq);
+	mdata->credit[class]--;
 
 	if (rq_data_dir(rq)) {
 		mdata->starved = 0;
 	} else {
-		if (!list_empty(&mdata->fifo_list[SYNC][WRITE]) ||
-				!list_empty(&mdata->fifo_list[ASYNC][WRITE]))
+		if (!list_empty(&mdata->fifo_list[class][SYNC][WRITE]) ||
+				!list_empty(&mdata->fifo_list[class][ASYNC][WRITE]))
 			mdata->starved++;
 	}
 }
@@ -207,13 +339,17 @@ maple_dispatch_requests(struct request_queue *q, int force)
 	struct request *rq = NULL;
 	int data_dir = READ;
 	const bool display_on = is_display_on();
+	const int class = maple_choose_class(mdata);
+
+	if (class < 0)
+		return 0;
 
 	/*
 	 * Retrieve any expired request after a batch of
 	 * sequential requests.
 	 */
 	if (mdata->batched >= mdata->fifo_batch)
-		rq = maple_choose_expired_request(mdata);
+		rq = maple_choose_expired_request(mdata, class);
 
 	/* Retrieve request */
 	if (!rq) {
@@ -223,7 +359,7 @@ maple_dispatch_requests(struct request_queue *q, int force)
 		else if (!display_on && mdata->starved >= 1)
 			data_dir = WRITE;
 
-		rq = maple_choose_request(mdata, data_dir);
+		rq = maple_choose_request(mdata, class, data_dir);
 		if (!rq)
 			return 0;
 	}
@@ -240,8 +376,9 @@ maple_former_request(struct request_queue *q, struct request *rq)
 	struct maple_data *mdata = maple_get_data(q);
 	const int sync = rq_is_sync(rq);
 	const int data_dir = rq_data_dir(rq);
+	const int class = maple_rq_class(rq);
 
-	if (rq->queuelist.prev == &mdata->fifo_list[sync][data_dir])
+	if (rq->queuelist.prev == &mdata->fifo_list[class][sync][data_dir])
 		return NULL;
 
 	/* Return former request */
@@ -254,8 +391,9 @@ maple_latter_request(struct request_queue *q, struct request *rq)
 	struct maple_data *mdata = maple_get_data(q);
 	const int sync = rq_is_sync(rq);
 	const int data_dir = rq_data_dir(rq);
+	const int class = maple_rq_class(rq);
 
-	if (rq->queuelist.next == &mdata->fifo_list[sync][data_dir])
+	if (rq->queuelist.next == &mdata->fifo_list[class][sync][data_dir])
 		return NULL;
 
 	/* Return latter request */
@@ -266,6 +404,7 @@ static int maple_init_queue(struct request_queue *q, struct elevator_type *e)
 {
 	struct maple_data *mdata;
 	struct elevator_queue *eq;
+	int class;
 
 	eq = elevator_alloc(q, e);
 	if (!eq)
@@ -280,10 +419,12 @@ static int maple_init_queue(struct request_queue *q, struct elevator_type *e)
 	eq->elevator_data = mdata;
 
 	/* Initialize fifo lists */
-	INIT_LIST_HEAD(&mdata->fifo_list[SYNC][READ]);
-	INIT_LIST_HEAD(&mdata->fifo_list[SYNC][WRITE]);
-	INIT_LIST_HEAD(&mdata->fifo_list[ASYNC][READ]);
-	INIT_LIST_HEAD(&mdata->fifo_list[ASYNC][WRITE]);
+	for (class = 0; class < MAPLE_NR_CLASSES; class++) {
+		INIT_LIST_HEAD(&mdata->fifo_list[class][SYNC][READ]);
+		INIT_LIST_HEAD(&mdata->fifo_list[class][SYNC][WRITE]);
+		INIT_LIST_HEAD(&mdata->fifo_list[class][ASYNC][READ]);
+		INIT_LIST_HEAD(&mdata->fifo_list[class][ASYNC][WRITE]);
+	}
 
 	/* Initialize data */
 	mdata->batched = 0;
@@ -294,6 +435,12 @@ static int maple_init_queue(struct request_queue *q, struct elevator_type *e)
 	mdata->fifo_batch = fifo_batch;
 	mdata->writes_starved = writes_starved;
 	mdata->sleep_latency_multiple = sleep_latency_multiple;
+	mdata->class_enabled = class_enabled;
+	mdata->class_weight[SYS_CLASS] = sys_weight;
+	mdata->class_weight[FG_CLASS] = fg_weight;
+	mdata->class_weight[BG_CLASS] = bg_weight;
+	for (class = 0; class < MAPLE_NR_CLASSES; class++)
+		mdata->credit[class] = mdata->class_weight[class];
 
 	spin_lock_irq(q->queue_lock);
 	q->elevator = eq;
@@ -345,6 +492,10 @@ SHOW_FUNCTION(maple_async_write_expire_show, mdata->fifo_expire[ASYNC][WRITE], 1
 SHOW_FUNCTION(maple_fifo_batch_show, mdata->fifo_batch, 0);
 SHOW_FUNCTION(maple_writes_starved_show, mdata->writes_starved, 0);
 SHOW_FUNCTION(maple_sleep_latency_multiple_show, mdata->sleep_latency_multiple, 0);
+SHOW_FUNCTION(maple_class_enabled_show, mdata->class_enabled, 0);
+SHOW_FUNCTION(maple_sys_weight_show, mdata->class_weight[SYS_CLASS], 0);
+SHOW_FUNCTION(maple_fg_weight_show, mdata->class_weight[FG_CLASS], 0);
+SHOW_FUNCTION(maple_bg_weight_show, mdata->class_weight[BG_CLASS], 0);
 #undef SHOW_FUNCTION
 
 #define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
@@ -370,6 +521,10 @@ STORE_FUNCTION(maple_async_write_expire_store, &mdata->fifo_expire[ASYNC][WRITE]
 STORE_FUNCTION(maple_fifo_batch_store, &mdata->fifo_batch, 1, INT_MAX, 0);
 STORE_FUNCTION(maple_writes_starved_store, &mdata->writes_starved, 1, INT_MAX, 0);
 STORE_FUNCTION(maple_sleep_latency_multiple_store, &mdata->sleep_latency_multiple, 1, INT_MAX, 0);
+STORE_FUNCTION(maple_class_enabled_store, &mdata->class_enabled, 0, 1, 0);
+STORE_FUNCTION(maple_sys_weight_store, &mdata->class_weight[SYS_CLASS], 1, INT_MAX, 0);
+STORE_FUNCTION(maple_fg_weight_store, &mdata->class_weight[FG_CLASS], 1, INT_MAX, 0);
+STORE_FUNCTION(maple_bg_weight_store, &mdata->class_weight[BG_CLASS], 1, INT_MAX, 0);
 #undef STORE_FUNCTION
 
 #define DD_ATTR(name) \
@@ -384,6 +539,10 @@ static struct elv_fs_entry maple_attrs[] = {
 	DD_ATTR(fifo_batch),
 	DD_ATTR(writes_starved),
   DD_ATTR(sleep_latency_multiple),
+	DD_ATTR(class_enabled),
+	DD_ATTR(sys_weight),
+	DD_ATTR(fg_weight),
+	DD_ATTR(bg_weight),
 	__ATTR_NULL
 };
 
@@ -19,6 +19,9 @@
 #ifdef CONFIG_ZRAM_LZ4_COMPRESS
 #include "zcomp_lz4.h"
 #endif
+#ifdef CONFIG_ZRAM_LZ4HC_COMPRESS
+#include "zcomp_lz4hc.h"
+#endif
 
 /*
  * single zcomp_strm backend
@@ -47,6 +50,9 @@ static struct zcomp_backend *backends[] = {
 	&zcomp_lzo,
 #ifdef CONFIG_ZRAM_LZ4_COMPRESS
 	&zcomp_lz4,
+#endif
+#ifdef CONFIG_ZRAM_LZ4HC_COMPRESS
+	&zcomp_lz4hc,
 #endif
 	NULL
 };
@@ -67,6 +73,8 @@ static void zcomp_strm_free(struct zcomp *comp, struct zcomp_strm *zstrm)
 	if (zstrm->private)
 		comp->backend->destroy(zstrm->private);
 	free_pages((unsigned long)zstrm->buffer, 1);
+	if (zstrm->batch)
+		free_pages((unsigned long)zstrm->batch, ZCOMP_BATCH_ORDER);
 	kfree(zstrm);
 }
 
@@ -86,6 +94,12 @@ static struct zcomp_strm *zcomp_strm_alloc(struct zcomp *comp)
 	 * case when compressed size is larger than the original one
 	 */
 	zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL | __GFP_ZERO, 1);
+	/*
+	 * the batch area is only an optimisation, so don't try hard to get
+	 * it and don't fail the stream allocation without it
+	 */
+	zstrm->batch = (void *)__get_free_pages(GFP_KERNEL | __GFP_NORETRY |
+			__GFP_NOWARN, ZCOMP_BATCH_ORDER);
 	if (!zstrm->private || !zstrm->buffer) {
 		zcomp_strm_free(comp, zstrm);
 		zstrm = NULL;
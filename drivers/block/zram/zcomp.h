@@ -12,9 +12,22 @@
 
 #include <linux/mutex.h>
 
+/*
+ * Order of the per-stream staging area used by the batched write path:
+ * compressed objects of up to (1 << ZCOMP_BATCH_ORDER) pages are packed
+ * there before they are copied out to the allocator.
+ */
+#define ZCOMP_BATCH_ORDER	3
+#define ZCOMP_BATCH_PAGES	(1 << ZCOMP_BATCH_ORDER)
+
 struct zcomp_strm {
 	/* compression/decompression buffer */
 	void *buffer;
+	/*
+	 * batch staging area, may be NULL if it could not be allocated,
+	 * in which case callers must fall back to per-page compression
+	 */
+	void *batch;
 	/*
 	 * The private data of the compression stream, only compression
 	 * stream backend can touch this (e.g. compression algorithm
@@ -0,0 +1,138 @@
+/*
+ * Deduplication of compressed zram objects
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "zram_drv.h"
+
+/* One hash bucket per (1 << ZRAM_HASH_SHIFT) table entries */
+#define ZRAM_HASH_SHIFT	4
+
+static struct zram_hash *hash_bucket(struct zram_meta *meta, u32 checksum)
+{
+	return &meta->hash[checksum & (meta->hash_size - 1)];
+}
+
+u32 zram_dedup_checksum(const unsigned char *mem, size_t len)
+{
+	return jhash(mem, len, 0);
+}
+
+/*
+ * Look for an object holding the @len bytes at @mem. On success the
+ * object's reference count is raised and the caller has to drop it with
+ * zram_dedup_put() once done.
+ */
+struct zram_entry *zram_dedup_find(struct zram_meta *meta,
+		const unsigned char *mem, size_t len, u32 checksum)
+{
+	struct zram_hash *hash = hash_bucket(meta, checksum);
+	struct zram_entry *entry;
+	unsigned char *cmem;
+	bool match;
+
+	spin_lock(&hash->lock);
+	hlist_for_each_entry(entry, &hash->head, node) {
+		if (entry->checksum != checksum || entry->len != len)
+			continue;
+
+		cmem = zpool_map_handle(meta->mem_pool, entry->handle,
+				ZPOOL_MM_RO);
+		match = !memcmp(cmem, mem, len);
+		zpool_unmap_handle(meta->mem_pool, entry->handle);
+		if (match) {
+			entry->refcount++;
+			spin_unlock(&hash->lock);
+			return entry;
+		}
+	}
+	spin_unlock(&hash->lock);
+
+	return NULL;
+}
+
+/*
+ * Make the object at @handle available to zram_dedup_find(). Returns NULL
+ * if no entry could be allocated, the caller then keeps using @handle as
+ * a plain, unshared, object.
+ */
+struct zram_entry *zram_dedup_insert(struct zram_meta *meta,
+		unsigned long handle, size_t len, u32 checksum)
+{
+	struct zram_hash *hash = hash_bucket(meta, checksum);
+	struct zram_entry *entry;
+
+	entry = kmalloc(sizeof(*entry), GFP_NOIO | __GFP_NOWARN);
+	if (!entry)
+		return NULL;
+
+	entry->handle = handle;
+	entry->checksum = checksum;
+	entry->len = len;
+	entry->refcount = 1;
+
+	spin_lock(&hash->lock);
+	hlist_add_head(&entry->node, &hash->head);
+	spin_unlock(&hash->lock);
+
+	return entry;
+}
+
+/*
+ * Drop a reference to @entry, freeing the object with the last one.
+ * Returns true if the object has been freed.
+ */
+bool zram_dedup_put(struct zram_meta *meta, struct zram_entry *entry)
+{
+	struct zram_hash *hash = hash_bucket(meta, entry->checksum);
+
+	spin_lock(&hash->lock);
+	if (--entry->refcount) {
+		spin_unlock(&hash->lock);
+		return false;
+	}
+	hlist_del(&entry->node);
+	spin_unlock(&hash->lock);
+
+	zpool_free(meta->mem_pool, entry->handle);
+	kfree(entry);
+	return true;
+}
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	size_t i;
+
+	meta->hash_size = roundup_pow_of_two(
+			max_t(size_t, num_pages >> ZRAM_HASH_SHIFT, 1));
+	meta->hash = vzalloc(meta->hash_size * sizeof(*meta->hash));
+	if (!meta->hash) {
+		meta->hash_size = 0;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < meta->hash_size; i++) {
+		spin_lock_init(&meta->hash[i].lock);
+		INIT_HLIST_HEAD(&meta->hash[i].head);
+	}
+
+	return 0;
+}
+
+void zram_dedup_fini(struct zram_meta *meta)
+{
+	vfree(meta->hash);
+	meta->hash = NULL;
+	meta->hash_size = 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Deduplication of compressed zram objects
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ */
+
+#ifndef _ZRAM_DEDUP_H_
+#define _ZRAM_DEDUP_H_
+
+#include <linux/list.h>
+#include <linux/spinlock.h>
+
+struct zram_meta;
+
+/*
+ * A compressed object shared by all the table entries which stored the
+ * same data. Table entries with ZRAM_DEDUP set point to one of these
+ * instead of holding the zpool handle directly.
+ */
+struct zram_entry {
+	struct hlist_node node;
+	unsigned long handle;	/* zpool handle of the object */
+	u32 checksum;
+	unsigned int len;
+	/* protected by the hash bucket lock */
+	unsigned int refcount;
+};
+
+struct zram_hash {
+	spinlock_t lock;
+	struct hlist_head head;
+};
+
+#ifdef CONFIG_ZRAM_DEDUP
+u32 zram_dedup_checksum(const unsigned char *mem, size_t len);
+struct zram_entry *zram_dedup_find(struct zram_meta *meta,
+		const unsigned char *mem, size_t len, u32 checksum);
+struct zram_entry *zram_dedup_insert(struct zram_meta *meta,
+		unsigned long handle, size_t len, u32 checksum);
+bool zram_dedup_put(struct zram_meta *meta, struct zram_entry *entry);
+
+int zram_dedup_init(struct zram_meta *meta, size_t num_pages);
+void zram_dedup_fini(struct zram_meta *meta);
+#else
+static inline u32 zram_dedup_checksum(const unsigned char *mem, size_t len)
+{
+	return 0;
+}
+
+static inline struct zram_entry *zram_dedup_find(struct zram_meta *meta,
+		const unsigned char *mem, size_t len, u32 checksum)
+{
+	return NULL;
+}
+
+static inline struct zram_entry *zram_dedup_insert(struct zram_meta *meta,
+		unsigned long handle, size_t len, u32 checksum)
+{
+	return NULL;
+}
+
+static inline bool zram_dedup_put(struct zram_meta *meta,
+		struct zram_entry *entry)
+{
+	return false;
+}
+
+static inline int zram_dedup_init(struct zram_meta *meta, size_t num_pages)
+{
+	return -EINVAL;
+}
+
+static inline void zram_dedup_fini(struct zram_meta *meta) {}
+#endif
+
+#endif /* _ZRAM_DEDUP_H_ */
@@ -39,6 +39,11 @@
 #include <linux/ratelimit.h>
 #include <linux/show_mem_notifier.h>
 #include <linux/err.h>
+#include <linux/timex.h>
+#include <linux/kthread.h>
+#include <linux/cpumask.h>
+#include <linux/file.h>
+#include <linux/workqueue.h>
 
 #include "zram_drv.h"
 
@@ -58,6 +63,11 @@ static char backend_param_buf[BACKEND_PARAM_BUF_SIZE];
 /* Module params (documentation at end) */
 static unsigned int num_devices = 1;
 
+/* Asynchronous compression workers, shared by all devices */
+static struct zram_comp_worker *zram_workers;
+static int nr_zram_workers;
+static atomic_t zram_next_worker = ATOMIC_INIT(0);
+
 static inline void deprecated_attr_warn(const char *name)
 {
 	pr_warn_once("%d (%s) Attribute %s (and others) will be removed. %s\n",
@@ -309,6 +319,68 @@ out:
 	return ret;
 }
 
+static ssize_t async_comp_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", zram->async_comp);
+}
+
+static ssize_t async_comp_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (strtobool(buf, &val))
+		return -EINVAL;
+
+	if (val && !nr_zram_workers) {
+		pr_info("No compression workers available\n");
+		return -ENODEV;
+	}
+
+	zram->async_comp = val;
+	return len;
+}
+
+static ssize_t use_dedup_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	down_read(&zram->init_lock);
+	val = zram->use_dedup;
+	up_read(&zram->init_lock);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", val);
+}
+
+static ssize_t use_dedup_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	bool val;
+
+	if (strtobool(buf, &val))
+		return -EINVAL;
+
+	if (!IS_ENABLED(CONFIG_ZRAM_DEDUP) && val)
+		return -EINVAL;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change dedup usage for initialized device\n");
+		return -EBUSY;
+	}
+	zram->use_dedup = val;
+	up_write(&zram->init_lock);
+	return len;
+}
+
 static ssize_t comp_algorithm_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -337,7 +409,35 @@ static ssize_t comp_algorithm_store(struct device *dev,
 	return len;
 }
 
-/* flag operations needs meta->tb_lock */
+static ssize_t recomp_algorithm_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	size_t sz;
+	struct zram *zram = dev_to_zram(dev);
+
+	down_read(&zram->init_lock);
+	sz = zcomp_available_show(zram->recomp_algorithm, buf);
+	up_read(&zram->init_lock);
+
+	return sz;
+}
+
+static ssize_t recomp_algorithm_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		up_write(&zram->init_lock);
+		pr_info("Can't change algorithm for initialized device\n");
+		return -EBUSY;
+	}
+	strlcpy(zram->recomp_algorithm, buf, sizeof(zram->recomp_algorithm));
+	up_write(&zram->init_lock);
+	return len;
+}
+
+/* flag operations need the slot lock */
 static int zram_test_flag(struct zram_meta *meta, u32 index,
 			enum zram_pageflags flag)
 {
@@ -369,6 +469,37 @@ static void zram_set_obj_size(struct zram_meta *meta,
 	meta->table[index].value = (flags << ZRAM_FLAG_SHIFT) | size;
 }
 
+/*
+ * Every table entry is protected by its own bit spinlock, kept in the
+ * ZRAM_ACCESS bit of its value, so that I/O to different slots never
+ * shares a lock.
+ */
+static void zram_slot_lock(struct zram *zram, u32 index)
+{
+	unsigned long *lock = &zram->meta->table[index].value;
+
+	if (likely(bit_spin_trylock(ZRAM_ACCESS, lock)))
+		return;
+
+	atomic64_inc(&zram->stats.slot_lock_contended);
+	bit_spin_lock(ZRAM_ACCESS, lock);
+}
+
+static void zram_slot_unlock(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_ACCESS, &zram->meta->table[index].value);
+}
+
+/* zpool handle of the object stored for a slot, needs the slot lock */
+static unsigned long zram_get_handle(struct zram_meta *meta, u32 index)
+{
+	unsigned long handle = meta->table[index].handle;
+
+	if (zram_test_flag(meta, index, ZRAM_DEDUP))
+		return ((struct zram_entry *)handle)->handle;
+	return handle;
+}
+
 static inline int is_partial_io(struct bio_vec *bvec)
 {
 	return bvec->bv_len != PAGE_SIZE;
@@ -407,22 +538,32 @@ static void zram_meta_free(struct zram_meta *meta, u64 disksize)
 	for (index = 0; index < num_pages; index++) {
 		unsigned long handle = meta->table[index].handle;
 
-		if (!handle)
+		if (!handle || zram_test_flag(meta, index, ZRAM_SAME))
+			continue;
+#ifdef CONFIG_ZRAM_WRITEBACK
+		/* the backing device is released by reset_bdev() */
+		if (zram_test_flag(meta, index, ZRAM_WB))
 			continue;
+#endif
 
-		zpool_free(meta->mem_pool, handle);
+		if (zram_test_flag(meta, index, ZRAM_DEDUP))
+			zram_dedup_put(meta, (struct zram_entry *)handle);
+		else
+			zpool_free(meta->mem_pool, handle);
 	}
 
+	zram_dedup_fini(meta);
 	zpool_destroy_pool(meta->mem_pool);
 	vfree(meta->table);
 	kfree(meta);
 }
 
-static struct zram_meta *zram_meta_alloc(int device_id, u64 disksize)
+static struct zram_meta *zram_meta_alloc(int device_id, u64 disksize,
+					 bool use_dedup)
 {
 	size_t num_pages;
 	char pool_name[8];
-	struct zram_meta *meta = kmalloc(sizeof(*meta), GFP_KERNEL);
+	struct zram_meta *meta = kzalloc(sizeof(*meta), GFP_KERNEL);
 	char *backend;
 
 	if (!meta)
@@ -444,6 +585,12 @@ static struct zram_meta *zram_meta_alloc(int device_id, u64 disksize)
 		goto out_error;
 	}
 
+	if (use_dedup && zram_dedup_init(meta, num_pages)) {
+		pr_err("Error allocating zram dedup table\n");
+		zpool_destroy_pool(meta->mem_pool);
+		goto out_error;
+	}
+
 	return meta;
 
 out_error:
@@ -461,7 +608,8 @@ static inline bool zram_meta_get(struct zram *zram)
 
 static inline void zram_meta_put(struct zram *zram)
 {
-	atomic_dec(&zram->refcount);
+	if (atomic_dec_and_test(&zram->refcount))
+		wake_up(&zram->io_done);
 }
 
 static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
@@ -471,40 +619,213 @@ static void update_position(u32 *index, int *offset, struct bio_vec *bvec)
 	*offset = (*offset + bvec->bv_len) % PAGE_SIZE;
 }
 
-static int page_zero_filled(void *ptr)
+static bool page_same_filled(void *ptr, unsigned long *element)
 {
-	unsigned int pos;
+	unsigned int pos, last_pos = PAGE_SIZE / sizeof(*element) - 1;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
-			return 0;
+	/* most pages differ at the end already, don't scan them */
+	if (val != page[last_pos])
+		return false;
+
+	for (pos = 1; pos < last_pos; pos++) {
+		if (val != page[pos])
+			return false;
 	}
 
-	return 1;
+	*element = val;
+	return true;
 }
 
-static void handle_zero_page(struct bio_vec *bvec)
+static void zram_fill_page(void *ptr, unsigned long len,
+			   unsigned long value)
+{
+	unsigned long *page = ptr;
+	unsigned int pos;
+
+	WARN_ON_ONCE(!IS_ALIGNED(len, sizeof(unsigned long)));
+
+	if (likely(value == 0)) {
+		memset(ptr, 0, len);
+		return;
+	}
+
+	for (pos = 0; pos < len / sizeof(*page); pos++)
+		page[pos] = value;
+}
+
+static void handle_same_page(struct bio_vec *bvec, unsigned long element)
 {
 	struct page *page = bvec->bv_page;
 	void *user_mem;
 
 	user_mem = kmap_atomic(page);
-	if (is_partial_io(bvec))
-		memset(user_mem + bvec->bv_offset, 0, bvec->bv_len);
-	else
-		clear_page(user_mem);
+	zram_fill_page(user_mem + bvec->bv_offset, bvec->bv_len, element);
 	kunmap_atomic(user_mem);
 
 	flush_dcache_page(page);
 }
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* flag operations need the slot lock */
+static void zram_accessed(struct zram_meta *meta, u32 index)
+{
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	meta->table[index].ac_time = jiffies;
+}
+
+static void reset_bdev(struct zram *zram)
+{
+	if (!zram->backing_dev)
+		return;
+
+	blkdev_put(zram->bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+	filp_close(zram->backing_dev, NULL);
+	vfree(zram->bitmap);
+	zram->backing_dev = NULL;
+	zram->bdev = NULL;
+	zram->bitmap = NULL;
+	zram->nr_pages = 0;
+}
+
+/*
+ * Allocate @nr contiguous blocks on the backing device, returns the first
+ * one or 0 if there is no such range. Block 0 is never handed out so that
+ * a zero handle keeps meaning "no data".
+ */
+static unsigned long alloc_block_bdev(struct zram *zram, int nr)
+{
+	unsigned long blk;
+
+	spin_lock(&zram->bitmap_lock);
+	blk = bitmap_find_next_zero_area(zram->bitmap, zram->nr_pages, 1,
+			nr, 0);
+	if (blk >= zram->nr_pages) {
+		spin_unlock(&zram->bitmap_lock);
+		return 0;
+	}
+	bitmap_set(zram->bitmap, blk, nr);
+	spin_unlock(&zram->bitmap_lock);
+
+	return blk;
+}
+
+static void free_block_bdev(struct zram *zram, unsigned long blk)
+{
+	spin_lock(&zram->bitmap_lock);
+	WARN_ON_ONCE(!test_bit(blk, zram->bitmap));
+	bitmap_clear(zram->bitmap, blk, 1);
+	spin_unlock(&zram->bitmap_lock);
+}
+
+/*
+ * Swap-in may need a backing device read to make progress under memory
+ * pressure, so it gets a rescuer rather than relying on system_unbound_wq.
+ */
+static struct workqueue_struct *zram_bdev_wq;
+
+struct zram_bdev_read {
+	struct work_struct work;
+	struct zram *zram;
+	struct page *page;
+	unsigned long blk;
+	int ret;
+};
+
+static void zram_bdev_read_fn(struct work_struct *work)
+{
+	struct zram_bdev_read *req = container_of(work,
+			struct zram_bdev_read, work);
+	struct bio *bio;
+
+	bio = bio_alloc(GFP_NOIO, 1);
+	bio->bi_sector = req->blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = req->zram->bdev;
+	if (bio_add_page(bio, req->page, PAGE_SIZE, 0) != PAGE_SIZE) {
+		bio_put(bio);
+		req->ret = -EIO;
+		return;
+	}
+
+	req->ret = submit_bio_wait(READ, bio);
+	bio_put(bio);
+}
+
+/*
+ * Read block @blk of the backing device into @page. We are called from
+ * zram's make_request function, where a bio submitted to another device
+ * is only dispatched once we return, so the read is issued from a worker
+ * and waited upon.
+ */
+static int read_from_bdev(struct zram *zram, struct page *page,
+			  unsigned long blk)
+{
+	struct zram_bdev_read req;
+
+	req.zram = zram;
+	req.page = page;
+	req.blk = blk;
+	req.ret = 0;
+
+	INIT_WORK_ONSTACK(&req.work, zram_bdev_read_fn);
+	queue_work(zram_bdev_wq, &req.work);
+	flush_work(&req.work);
+	destroy_work_on_stack(&req.work);
+
+	atomic64_inc(&zram->stats.bd_reads);
+	return req.ret;
+}
+#else
+static inline void zram_accessed(struct zram_meta *meta, u32 index) {}
+static inline void reset_bdev(struct zram *zram) {}
+#endif
+
+/*
+ * Dedup helpers keeping the stats straight: every shared object is
+ * accounted once in compr_data_size, every additional reference to it in
+ * dup_data_size.
+ */
+static struct zram_entry *zram_entry_find(struct zram *zram,
+		const unsigned char *mem, size_t len, u32 checksum)
+{
+	struct zram_entry *entry;
+
+	entry = zram_dedup_find(zram->meta, mem, len, checksum);
+	if (entry)
+		atomic64_add(len, &zram->stats.dup_data_size);
+	return entry;
+}
+
+static struct zram_entry *zram_entry_insert(struct zram *zram,
+		unsigned long handle, size_t len, u32 checksum)
+{
+	struct zram_entry *entry;
+
+	entry = zram_dedup_insert(zram->meta, handle, len, checksum);
+	if (entry)
+		atomic64_add(sizeof(*entry), &zram->stats.meta_data_size);
+	return entry;
+}
+
+static void zram_entry_put(struct zram *zram, struct zram_entry *entry)
+{
+	size_t len = entry->len;
+
+	if (zram_dedup_put(zram->meta, entry)) {
+		atomic64_sub(len, &zram->stats.compr_data_size);
+		atomic64_sub(sizeof(*entry), &zram->stats.meta_data_size);
+	} else {
+		atomic64_sub(len, &zram->stats.dup_data_size);
+	}
+}
 
 /*
  * To protect concurrent access to the same index entry,
- * caller should hold this table index entry's bit_spinlock to
+ * caller should hold this table index entry's slot lock to
  * indicate this index entry is accessing.
  */
 static void zram_free_page(struct zram *zram, size_t index)
@@ -512,22 +833,42 @@ static void zram_free_page(struct zram *zram, size_t index)
 	struct zram_meta *meta = zram->meta;
 	unsigned long handle = meta->table[index].handle;
 
-	if (unlikely(!handle)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(meta, index, ZRAM_ZERO)) {
-			zram_clear_flag(meta, index, ZRAM_ZERO);
-			atomic64_dec(&zram->stats.zero_pages);
-		}
+	zram_clear_flag(meta, index, ZRAM_RECOMP);
+	zram_clear_flag(meta, index, ZRAM_UNDER_RECOMP);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_clear_flag(meta, index, ZRAM_IDLE);
+	zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		zram_clear_flag(meta, index, ZRAM_WB);
+		free_block_bdev(zram, handle);
+		atomic64_dec(&zram->stats.bd_count);
+		meta->table[index].handle = 0;
+		return;
+	}
+#endif
+
+	/*
+	 * No memory is allocated for same element filled pages.
+	 * Simply clear same page flag.
+	 */
+	if (zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_clear_flag(meta, index, ZRAM_SAME);
+		atomic64_dec(&zram->stats.same_pages);
+		meta->table[index].handle = 0;
 		return;
 	}
 
-	zpool_free(meta->mem_pool, handle);
+	if (unlikely(!handle))
+		return;
 
-	atomic64_sub(zram_get_obj_size(meta, index),
-			&zram->stats.compr_data_size);
+	if (zram_test_flag(meta, index, ZRAM_DEDUP)) {
+		zram_clear_flag(meta, index, ZRAM_DEDUP);
+		zram_entry_put(zram, (struct zram_entry *)handle);
+	} else {
+		zpool_free(meta->mem_pool, handle);
+		atomic64_sub(zram_get_obj_size(meta, index),
+				&zram->stats.compr_data_size);
+	}
 	atomic64_dec(&zram->stats.pages_stored);
 
 	meta->table[index].handle = 0;
@@ -539,16 +880,35 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	int ret = 0;
 	unsigned char *cmem;
 	struct zram_meta *meta = zram->meta;
+	struct zcomp *comp = zram->comp;
 	unsigned long handle;
 	size_t size;
 
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-	handle = meta->table[index].handle;
+	zram_slot_lock(zram, index);
+	handle = zram_get_handle(meta, index);
 	size = zram_get_obj_size(meta, index);
+	if (zram_test_flag(meta, index, ZRAM_RECOMP))
+		comp = zram->recomp;
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(meta, index, ZRAM_WB)) {
+		struct page *page;
+
+		zram_slot_unlock(zram, index);
+		page = alloc_page(GFP_NOIO);
+		if (!page)
+			return -ENOMEM;
+		ret = read_from_bdev(zram, page, handle);
+		if (!ret)
+			copy_page(mem, page_address(page));
+		__free_page(page);
+		return ret;
+	}
+#endif
 
-	if (!handle || zram_test_flag(meta, index, ZRAM_ZERO)) {
-		clear_page(mem);
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	if (!handle || zram_test_flag(meta, index, ZRAM_SAME)) {
+		zram_fill_page(mem, PAGE_SIZE, handle);
+		zram_slot_unlock(zram, index);
 		return 0;
 	}
 
@@ -556,9 +916,9 @@ static int zram_decompress_page(struct zram *zram, char *mem, u32 index)
 	if (size == PAGE_SIZE)
 		copy_page(mem, cmem);
 	else
-		ret = zcomp_decompress(zram->comp, cmem, size, mem);
+		ret = zcomp_decompress(comp, cmem, size, mem);
 	zpool_unmap_handle(meta->mem_pool, handle);
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_unlock(zram, index);
 
 	/* Should NEVER happen. Return bio error if it does. */
 	if (unlikely(ret)) {
@@ -578,20 +938,38 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	struct zram_meta *meta = zram->meta;
 	page = bvec->bv_page;
 
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_lock(zram, index);
+	zram_accessed(meta, index);
 	if (unlikely(!meta->table[index].handle) ||
-			zram_test_flag(meta, index, ZRAM_ZERO)) {
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		handle_zero_page(bvec);
+			zram_test_flag(meta, index, ZRAM_SAME)) {
+		unsigned long element = meta->table[index].handle;
+
+		zram_slot_unlock(zram, index);
+		handle_same_page(bvec, element);
 		return 0;
 	}
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	if (zram_test_flag(meta, index, ZRAM_WB) && !is_partial_io(bvec)) {
+		unsigned long blk = meta->table[index].handle;
+
+		zram_slot_unlock(zram, index);
+		ret = read_from_bdev(zram, page, blk);
+		if (!ret)
+			flush_dcache_page(page);
+		return ret;
+	}
+#endif
+	zram_slot_unlock(zram, index);
 
 	if (is_partial_io(bvec))
 		/* Use  a temporary buffer to decompress the page */
 		uncmem = kmalloc(PAGE_SIZE, GFP_NOIO);
 
-	user_mem = kmap_atomic(page);
+	/*
+	 * Not an atomic mapping: a page written back to the backing device
+	 * meanwhile is read back by zram_decompress_page(), which sleeps.
+	 */
+	user_mem = kmap(page);
 	if (!is_partial_io(bvec))
 		uncmem = user_mem;
 
@@ -613,7 +991,7 @@ static int zram_bvec_read(struct zram *zram, struct bio_vec *bvec,
 	flush_dcache_page(page);
 	ret = 0;
 out_cleanup:
-	kunmap_atomic(user_mem);
+	kunmap(page);
 	if (is_partial_io(bvec))
 		kfree(uncmem);
 	return ret;
@@ -639,14 +1017,17 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 {
 	int ret = 0;
 	size_t clen;
-	unsigned long handle;
+	unsigned long handle, element;
 	struct page *page;
 	unsigned char *user_mem, *cmem, *src, *uncmem = NULL;
 	struct zram_meta *meta = zram->meta;
 	static unsigned long zram_rs_time;
 	struct zcomp_strm *zstrm;
+	struct zram_entry *entry = NULL;
 	bool locked = false;
+	bool dedup = false;
 	unsigned long alloced_pages;
+	u32 checksum = 0;
 
 	page = bvec->bv_page;
 	if (is_partial_io(bvec)) {
@@ -677,16 +1058,18 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 		uncmem = user_mem;
 	}
 
-	if (page_zero_filled(uncmem)) {
+	if (page_same_filled(uncmem, &element)) {
 		if (user_mem)
 			kunmap_atomic(user_mem);
 		/* Free memory associated with this sector now. */
-		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_slot_lock(zram, index);
 		zram_free_page(zram, index);
-		zram_set_flag(meta, index, ZRAM_ZERO);
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+		zram_set_flag(meta, index, ZRAM_SAME);
+		meta->table[index].handle = element;
+		zram_accessed(meta, index);
+		zram_slot_unlock(zram, index);
 
-		atomic64_inc(&zram->stats.zero_pages);
+		atomic64_inc(&zram->stats.same_pages);
 		ret = 0;
 		goto out;
 	}
@@ -696,7 +1079,7 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	 * double check.
 	 */
 	if (unlikely(meta->table[index].handle ||
-			zram_test_flag(meta, index, ZRAM_ZERO)))
+			zram_test_flag(meta, index, ZRAM_SAME)))
 		zram_free_page(zram, index);
 
 	ret = zcomp_compress(zram->comp, zstrm, uncmem, &clen);
@@ -717,6 +1100,18 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 			src = uncmem;
 	}
 
+	/* pages stored as is are not worth hashing */
+	if (zram_dedup_enabled(meta) && clen != PAGE_SIZE) {
+		checksum = zram_dedup_checksum(src, clen);
+		entry = zram_entry_find(zram, src, clen, checksum);
+		if (entry) {
+			zcomp_strm_release(zram->comp, zstrm);
+			locked = false;
+			goto found_dup;
+		}
+		dedup = true;
+	}
+
 	if (zpool_malloc(meta->mem_pool, clen, __GFP_NORETRY | __GFP_NOWARN,
 			&handle) != 0) {
 		if (printk_timed_ratelimit(&zram_rs_time,
@@ -750,19 +1145,28 @@ static int zram_bvec_write(struct zram *zram, struct bio_vec *bvec, u32 index,
 	locked = false;
 	zpool_unmap_handle(meta->mem_pool, handle);
 
+	atomic64_add(clen, &zram->stats.compr_data_size);
+	if (dedup)
+		entry = zram_entry_insert(zram, handle, clen, checksum);
+found_dup:
 	/*
 	 * Free memory associated with this sector
 	 * before overwriting unused sectors.
 	 */
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
 
-	meta->table[index].handle = handle;
+	if (entry) {
+		zram_set_flag(meta, index, ZRAM_DEDUP);
+		meta->table[index].handle = (unsigned long)entry;
+	} else {
+		meta->table[index].handle = handle;
+	}
 	zram_set_obj_size(meta, index, clen);
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_accessed(meta, index);
+	zram_slot_unlock(zram, index);
 
 	/* Update stats */
-	atomic64_add(clen, &zram->stats.compr_data_size);
 	atomic64_inc(&zram->stats.pages_stored);
 out:
 	if (locked)
@@ -772,74 +1176,938 @@ out:
 	return ret;
 }
 
-static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
-			int offset, int rw)
-{
-	int ret;
-
-	if (rw == READ) {
-		atomic64_inc(&zram->stats.num_reads);
-		ret = zram_bvec_read(zram, bvec, index, offset);
-	} else {
-		atomic64_inc(&zram->stats.num_writes);
-		ret = zram_bvec_write(zram, bvec, index, offset);
-	}
-
-	if (unlikely(ret)) {
-		if (rw == READ)
-			atomic64_inc(&zram->stats.failed_reads);
-		else
-			atomic64_inc(&zram->stats.failed_writes);
-	}
-
-	return ret;
-}
+/* Per-page state of a batched write, see zram_bvec_write_batch() */
+struct zram_batch_slot {
+	unsigned long handle;
+	/* shared object, either found or inserted */
+	struct zram_entry *entry;
+	size_t clen;
+	/* offset of the compressed object in zstrm->batch */
+	unsigned int off;
+	u32 checksum;
+	bool same;
+	unsigned long element;
+};
 
 /*
- * zram_bio_discard - handler on discard request
- * @index: physical block index in PAGE_SIZE units
- * @offset: byte offset within physical block
+ * Store @nr full pages starting at table @index. All pages are compressed
+ * under a single stream into the stream's batch area, then the objects are
+ * allocated back to back, the memory limit is checked once for the whole
+ * batch and the table is updated last. Returns -EAGAIN if the stream has
+ * no batch area and the caller has to fall back to zram_bvec_write().
  */
-static void zram_bio_discard(struct zram *zram, u32 index,
-			     int offset, struct bio *bio)
+static int zram_bvec_write_batch(struct zram *zram, struct page **pages,
+				 int nr, u32 index)
 {
-	size_t n = bio->bi_size;
+	struct zram_batch_slot slots[ZCOMP_BATCH_PAGES];
 	struct zram_meta *meta = zram->meta;
+	static unsigned long zram_rs_time;
+	struct zcomp_strm *zstrm;
+	unsigned long alloced_pages;
+	unsigned char *user_mem, *cmem;
+	unsigned int off = 0;
+	int i, ret = 0;
 
-	/*
-	 * zram manages data in physical block size units. Because logical block
-	 * size isn't identical with physical block size on some arch, we
-	 * could get a discard request pointing to a specific offset within a
-	 * certain physical block.  Although we can handle this request by
-	 * reading that physiclal block and decompressing and partially zeroing
-	 * and re-compressing and then re-storing it, this isn't reasonable
-	 * because our intent with a discard request is to save memory.  So
-	 * skipping this logical block is appropriate here.
-	 */
-	if (offset) {
-		if (n <= (PAGE_SIZE - offset))
-			return;
-
-		n -= (PAGE_SIZE - offset);
-		index++;
+	zstrm = zcomp_strm_find(zram->comp);
+	if (!zstrm->batch) {
+		zcomp_strm_release(zram->comp, zstrm);
+		return -EAGAIN;
 	}
 
-	while (n >= PAGE_SIZE) {
-		bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
-		zram_free_page(zram, index);
-		bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
-		atomic64_inc(&zram->stats.notify_free);
-		index++;
-		n -= PAGE_SIZE;
-	}
+	for (i = 0; i < nr; i++) {
+		struct zram_batch_slot *slot = &slots[i];
+
+		slot->handle = 0;
+		slot->entry = NULL;
+		slot->same = false;
+		user_mem = kmap_atomic(pages[i]);
+		if (page_same_filled(user_mem, &slot->element)) {
+			kunmap_atomic(user_mem);
+			slot->same = true;
+			slot->clen = 0;
+			continue;
+		}
+
+		ret = zcomp_compress(zram->comp, zstrm, user_mem, &slot->clen);
+		kunmap_atomic(user_mem);
+		if (unlikely(ret)) {
+			pr_err("Compression failed! err=%d\n", ret);
+			goto out;
+		}
+
+		if (unlikely(slot->clen > max_zpage_size)) {
+			/* copied straight from the page when stored */
+			slot->clen = PAGE_SIZE;
+			continue;
+		}
+
+		/* max_zpage_size < PAGE_SIZE, so the batch area can't overflow */
+		slot->off = off;
+		memcpy(zstrm->batch + off, zstrm->buffer, slot->clen);
+		off += slot->clen;
+	}
+
+	for (i = 0; i < nr; i++) {
+		if (slots[i].same)
+			continue;
+
+		if (zram_dedup_enabled(meta) && slots[i].clen != PAGE_SIZE) {
+			unsigned char *src = zstrm->batch + slots[i].off;
+
+			slots[i].checksum = zram_dedup_checksum(src,
+					slots[i].clen);
+			slots[i].entry = zram_entry_find(zram, src,
+					slots[i].clen, slots[i].checksum);
+			if (slots[i].entry)
+				continue;
+		}
+
+		if (zpool_malloc(meta->mem_pool, slots[i].clen,
+				__GFP_NORETRY | __GFP_NOWARN,
+				&slots[i].handle) != 0) {
+			if (printk_timed_ratelimit(&zram_rs_time,
+						   ALLOC_ERROR_LOG_RATE_MS))
+				pr_info("Error allocating memory for compressed page: %u, size=%zu\n",
+					index + i, slots[i].clen);
+			ret = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	alloced_pages = zpool_get_total_size(meta->mem_pool) >> PAGE_SHIFT;
+	if (zram->limit_pages && alloced_pages > zram->limit_pages) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	update_used_max(zram, alloced_pages);
+
+	for (i = 0; i < nr; i++) {
+		if (slots[i].same || slots[i].entry)
+			continue;
+
+		cmem = zpool_map_handle(meta->mem_pool, slots[i].handle,
+				ZPOOL_MM_WO);
+		if (slots[i].clen == PAGE_SIZE) {
+			user_mem = kmap_atomic(pages[i]);
+			copy_page(cmem, user_mem);
+			kunmap_atomic(user_mem);
+		} else {
+			memcpy(cmem, zstrm->batch + slots[i].off,
+					slots[i].clen);
+		}
+		zpool_unmap_handle(meta->mem_pool, slots[i].handle);
+
+		atomic64_add(slots[i].clen, &zram->stats.compr_data_size);
+		if (zram_dedup_enabled(meta) && slots[i].clen != PAGE_SIZE)
+			slots[i].entry = zram_entry_insert(zram,
+					slots[i].handle, slots[i].clen,
+					slots[i].checksum);
+	}
+	zcomp_strm_release(zram->comp, zstrm);
+
+	for (i = 0; i < nr; i++) {
+		u32 slot_index = index + i;
+
+		zram_slot_lock(zram, slot_index);
+		zram_free_page(zram, slot_index);
+		if (slots[i].same) {
+			zram_set_flag(meta, slot_index, ZRAM_SAME);
+			meta->table[slot_index].handle = slots[i].element;
+		} else if (slots[i].entry) {
+			zram_set_flag(meta, slot_index, ZRAM_DEDUP);
+			meta->table[slot_index].handle =
+				(unsigned long)slots[i].entry;
+			zram_set_obj_size(meta, slot_index, slots[i].clen);
+		} else {
+			meta->table[slot_index].handle = slots[i].handle;
+			zram_set_obj_size(meta, slot_index, slots[i].clen);
+		}
+		zram_accessed(meta, slot_index);
+		zram_slot_unlock(zram, slot_index);
+
+		if (slots[i].same)
+			atomic64_inc(&zram->stats.same_pages);
+		else
+			atomic64_inc(&zram->stats.pages_stored);
+	}
+
+	return 0;
+
+out_free:
+	for (i = 0; i < nr; i++) {
+		if (slots[i].entry)
+			zram_entry_put(zram, slots[i].entry);
+		else if (slots[i].handle)
+			zpool_free(meta->mem_pool, slots[i].handle);
+	}
+out:
+	zcomp_strm_release(zram->comp, zstrm);
+	return ret;
+}
+
+static int zram_bvec_rw(struct zram *zram, struct bio_vec *bvec, u32 index,
+			int offset, int rw)
+{
+	int ret;
+
+	if (rw == READ) {
+		atomic64_inc(&zram->stats.num_reads);
+		ret = zram_bvec_read(zram, bvec, index, offset);
+	} else {
+		cycles_t start = get_cycles();
+
+		atomic64_inc(&zram->stats.num_writes);
+		ret = zram_bvec_write(zram, bvec, index, offset);
+		atomic64_add(get_cycles() - start, &zram->stats.single_cycles);
+	}
+
+	if (unlikely(ret)) {
+		if (rw == READ)
+			atomic64_inc(&zram->stats.failed_reads);
+		else
+			atomic64_inc(&zram->stats.failed_writes);
+	}
+
+	return ret;
+}
+
+/*
+ * Write @nr full pages at @index, in one batch if possible or page by
+ * page otherwise.
+ */
+static int zram_write_pages(struct zram *zram, struct page **pages, int nr,
+			    u32 index)
+{
+	cycles_t start = get_cycles();
+	int i, ret;
+
+	atomic64_add(nr, &zram->stats.num_writes);
+	ret = zram_bvec_write_batch(zram, pages, nr, index);
+	if (ret == -EAGAIN) {
+		atomic64_sub(nr, &zram->stats.num_writes);
+		for (i = 0; i < nr; i++) {
+			struct bio_vec bv = {
+				.bv_page = pages[i],
+				.bv_len = PAGE_SIZE,
+				.bv_offset = 0,
+			};
+
+			ret = zram_bvec_rw(zram, &bv, index + i, 0, WRITE);
+			if (ret)
+				return ret;
+		}
+		return 0;
+	}
+
+	if (unlikely(ret)) {
+		atomic64_add(nr, &zram->stats.failed_writes);
+		return ret;
+	}
+
+	atomic64_inc(&zram->stats.batched_writes);
+	atomic64_add(nr, &zram->stats.batched_pages);
+	atomic64_add(get_cycles() - start, &zram->stats.batched_cycles);
+	return 0;
+}
+
+static void zram_work_done(struct zram_work *work, int ret)
+{
+	struct zram_bio_ctx *ctx = work->ctx;
+	struct zram *zram = ctx->zram;
+
+	if (ret)
+		ctx->error = ret;
+	if (!atomic_dec_and_test(&ctx->pending))
+		return;
+
+	if (ctx->error) {
+		bio_io_error(ctx->bio);
+	} else {
+		set_bit(BIO_UPTODATE, &ctx->bio->bi_flags);
+		bio_endio(ctx->bio, 0);
+	}
+	kfree(ctx);
+	/* pairs with the zram_meta_get() in zram_make_request() */
+	zram_meta_put(zram);
+}
+
+static int zram_comp_worker_fn(void *data)
+{
+	struct zram_comp_worker *worker = data;
+	struct zram_work *work;
+	unsigned long pflags = current->flags;
+	int ret;
+
+	set_user_nice(current, -5);
+
+	while (!kthread_should_stop()) {
+		wait_event_interruptible(worker->wait,
+				!list_empty(&worker->works) ||
+				kthread_should_stop());
+
+		spin_lock(&worker->lock);
+		while (!list_empty(&worker->works)) {
+			work = list_first_entry(&worker->works,
+					struct zram_work, list);
+			list_del(&work->list);
+			spin_unlock(&worker->lock);
+
+			/*
+			 * Writes issued from reclaim are allowed to dip into
+			 * the reserves, keep it that way when we do the work
+			 * on their behalf.
+			 */
+			if (work->memalloc)
+				current->flags |= PF_MEMALLOC;
+			ret = zram_write_pages(work->ctx->zram, work->pages,
+					work->nr_pages, work->index);
+			tsk_restore_flags(current, pflags, PF_MEMALLOC);
+			zram_work_done(work, ret);
+
+			spin_lock(&worker->lock);
+		}
+		spin_unlock(&worker->lock);
+	}
+
+	return 0;
+}
+
+static void zram_queue_work(struct zram_work *work)
+{
+	struct zram_comp_worker *worker;
+	unsigned int id;
+
+	id = (unsigned int)atomic_inc_return(&zram_next_worker) %
+			nr_zram_workers;
+	worker = &zram_workers[id];
+
+	spin_lock(&worker->lock);
+	list_add_tail(&work->list, &worker->works);
+	spin_unlock(&worker->lock);
+	wake_up(&worker->wait);
+}
+
+/*
+ * zram_bio_write_async - hand a full page write over to the workers
+ * @index: physical block index in PAGE_SIZE units
+ *
+ * Returns 0 if the bio has been queued, it is then completed by the
+ * workers, which also drop the meta reference taken for this bio.
+ * Returns -EAGAIN if the bio has to be handled synchronously.
+ */
+static int zram_bio_write_async(struct zram *zram, u32 index,
+				struct bio *bio)
+{
+	struct zram_bio_ctx *ctx;
+	struct zram_work *works;
+	struct bio_vec *bvec;
+	int i, nr_works, nr = 0;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (bvec->bv_len != PAGE_SIZE || bvec->bv_offset)
+			return -EAGAIN;
+	}
+
+	nr_works = DIV_ROUND_UP(bio_segments(bio), ZCOMP_BATCH_PAGES);
+	ctx = kmalloc(sizeof(*ctx) + nr_works * sizeof(*works),
+			GFP_NOIO | __GFP_NOWARN);
+	if (!ctx)
+		return -EAGAIN;
+
+	works = (struct zram_work *)(ctx + 1);
+	ctx->zram = zram;
+	ctx->bio = bio;
+	ctx->error = 0;
+	atomic_set(&ctx->pending, nr_works);
+
+	bio_for_each_segment(bvec, bio, i) {
+		struct zram_work *work = &works[nr / ZCOMP_BATCH_PAGES];
+
+		if (!(nr % ZCOMP_BATCH_PAGES)) {
+			work->ctx = ctx;
+			work->nr_pages = 0;
+			work->index = index + nr;
+			work->memalloc = !!(current->flags & PF_MEMALLOC);
+		}
+		work->pages[work->nr_pages++] = bvec->bv_page;
+		nr++;
+	}
+
+	atomic64_inc(&zram->stats.async_writes);
+	for (i = 0; i < nr_works; i++)
+		zram_queue_work(&works[i]);
+
+	return 0;
+}
+
+/*
+ * One worker per cpu online at load time, but the workers are deliberately
+ * left unbound: work is handed out round robin rather than to the
+ * submitting cpu, so there is no locality to keep, and an unbound thread
+ * needs no hotplug handling and follows core_ctl isolation and the energy
+ * aware placement of the scheduler like any other task.
+ */
+static int zram_comp_workers_init(void)
+{
+	int i, nr = num_online_cpus();
+
+	zram_workers = kcalloc(nr, sizeof(*zram_workers), GFP_KERNEL);
+	if (!zram_workers)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		struct zram_comp_worker *worker = &zram_workers[i];
+
+		spin_lock_init(&worker->lock);
+		INIT_LIST_HEAD(&worker->works);
+		init_waitqueue_head(&worker->wait);
+		worker->task = kthread_run(zram_comp_worker_fn, worker,
+				"zram_comp/%d", i);
+		if (IS_ERR(worker->task))
+			break;
+	}
+
+	nr_zram_workers = i;
+	if (!nr_zram_workers) {
+		kfree(zram_workers);
+		zram_workers = NULL;
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void zram_comp_workers_destroy(void)
+{
+	int i;
+
+	for (i = 0; i < nr_zram_workers; i++)
+		kthread_stop(zram_workers[i].task);
+
+	kfree(zram_workers);
+	zram_workers = NULL;
+	nr_zram_workers = 0;
+}
+
+/*
+ * zram_bio_write_batched - handler for page aligned multi-page writes
+ * @index: physical block index in PAGE_SIZE units
+ *
+ * Returns -EAGAIN if @bio is not made of full pages only and has to go
+ * through the per-page path.
+ */
+static int zram_bio_write_batched(struct zram *zram, u32 index,
+				  struct bio *bio)
+{
+	struct page *pages[ZCOMP_BATCH_PAGES];
+	struct bio_vec *bvec;
+	int i, nr = 0, ret;
+
+	if (bio_segments(bio) < 2)
+		return -EAGAIN;
+
+	bio_for_each_segment(bvec, bio, i) {
+		if (bvec->bv_len != PAGE_SIZE || bvec->bv_offset)
+			return -EAGAIN;
+	}
+
+	bio_for_each_segment(bvec, bio, i) {
+		pages[nr++] = bvec->bv_page;
+		if (nr < ZCOMP_BATCH_PAGES && i < bio->bi_vcnt - 1)
+			continue;
+
+		ret = zram_write_pages(zram, pages, nr, index);
+		if (ret)
+			return ret;
+		index += nr;
+		nr = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * zram_bio_discard - handler on discard request
+ * @index: physical block index in PAGE_SIZE units
+ * @offset: byte offset within physical block
+ */
+static void zram_bio_discard(struct zram *zram, u32 index,
+			     int offset, struct bio *bio)
+{
+	size_t n = bio->bi_size;
+
+	/*
+	 * zram manages data in physical block size units. Because logical block
+	 * size isn't identical with physical block size on some arch, we
+	 * could get a discard request pointing to a specific offset within a
+	 * certain physical block.  Although we can handle this request by
+	 * reading that physiclal block and decompressing and partially zeroing
+	 * and re-compressing and then re-storing it, this isn't reasonable
+	 * because our intent with a discard request is to save memory.  So
+	 * skipping this logical block is appropriate here.
+	 */
+	if (offset) {
+		if (n <= (PAGE_SIZE - offset))
+			return;
+
+		n -= (PAGE_SIZE - offset);
+		index++;
+	}
+
+	while (n >= PAGE_SIZE) {
+		zram_slot_lock(zram, index);
+		zram_free_page(zram, index);
+		zram_slot_unlock(zram, index);
+		atomic64_inc(&zram->stats.notify_free);
+		index++;
+		n -= PAGE_SIZE;
+	}
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+/* Pages per bio submitted to the backing device by writeback_store() */
+#define ZRAM_WB_BATCH_PAGES	32
+
+static ssize_t backing_dev_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct file *file;
+	char *p;
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	file = zram->backing_dev;
+	if (!file) {
+		up_read(&zram->init_lock);
+		return scnprintf(buf, PAGE_SIZE, "none\n");
+	}
+
+	p = d_path(&file->f_path, buf, PAGE_SIZE - 1);
+	if (IS_ERR(p)) {
+		ret = PTR_ERR(p);
+		goto out;
+	}
+
+	ret = strlen(p);
+	memmove(buf, p, ret);
+	buf[ret++] = '\n';
+out:
+	up_read(&zram->init_lock);
+	return ret;
+}
+
+static ssize_t backing_dev_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct file *backing_dev = NULL;
+	struct block_device *bdev;
+	struct inode *inode;
+	unsigned long nr_pages, *bitmap;
+	char *file_name;
+	int err;
+
+	file_name = kmalloc(PATH_MAX, GFP_KERNEL);
+	if (!file_name)
+		return -ENOMEM;
+
+	strlcpy(file_name, buf, PATH_MAX);
+	/* ignore trailing newline */
+	if (len && file_name[min(len, (size_t)PATH_MAX - 1) - 1] == '\n')
+		file_name[min(len, (size_t)PATH_MAX - 1) - 1] = 0;
+
+	down_write(&zram->init_lock);
+	if (init_done(zram)) {
+		pr_info("Can't setup backing device for initialized device\n");
+		err = -EBUSY;
+		goto out;
+	}
+
+	backing_dev = filp_open(file_name, O_RDWR | O_LARGEFILE, 0);
+	if (IS_ERR(backing_dev)) {
+		err = PTR_ERR(backing_dev);
+		backing_dev = NULL;
+		goto out;
+	}
+
+	inode = backing_dev->f_mapping->host;
+	if (!S_ISBLK(inode->i_mode)) {
+		err = -ENOTBLK;
+		goto out;
+	}
+
+	bdev = bdgrab(I_BDEV(inode));
+	err = blkdev_get(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL, zram);
+	if (err < 0)
+		goto out;
+
+	nr_pages = i_size_read(inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_pages) * sizeof(long));
+	if (!bitmap || nr_pages < 2) {
+		vfree(bitmap);
+		blkdev_put(bdev, FMODE_READ | FMODE_WRITE | FMODE_EXCL);
+		err = bitmap ? -EINVAL : -ENOMEM;
+		goto out;
+	}
+
+	reset_bdev(zram);
+	zram->backing_dev = backing_dev;
+	zram->bdev = bdev;
+	zram->bitmap = bitmap;
+	zram->nr_pages = nr_pages;
+	up_write(&zram->init_lock);
+
+	pr_info("setup backing device %s\n", file_name);
+	kfree(file_name);
+	return len;
+
+out:
+	if (backing_dev)
+		filp_close(backing_dev, NULL);
+	up_write(&zram->init_lock);
+	kfree(file_name);
+	return err;
+}
+
+/*
+ * Mark allocated slots idle: all of them for "all", or those which have
+ * not been accessed for the given number of seconds otherwise. Accessing
+ * a slot clears the mark again.
+ */
+static ssize_t idle_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct zram_meta *meta;
+	unsigned long nr_pages, age = 0;
+	unsigned long index;
+	bool all;
+
+	all = sysfs_streq(buf, "all");
+	if (!all && (kstrtoul(buf, 10, &age) || !age))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_slot_lock(zram, index);
+		if (meta->table[index].handle &&
+		    !zram_test_flag(meta, index, ZRAM_SAME) &&
+		    !zram_test_flag(meta, index, ZRAM_WB) &&
+		    (all || time_after(jiffies,
+				meta->table[index].ac_time + age * HZ)))
+			zram_set_flag(meta, index, ZRAM_IDLE);
+		zram_slot_unlock(zram, index);
+		cond_resched();
+	}
+	up_read(&zram->init_lock);
+
+	return len;
+}
+
+/*
+ * Write @nr decompressed pages, which belong to the slots in @indexes, to
+ * a contiguous range of the backing device with a single bio and move the
+ * slots which have not been touched meanwhile over to the backing device.
+ */
+static int zram_writeback_pages(struct zram *zram, struct page **pages,
+				u32 *indexes, int nr)
+{
+	struct zram_meta *meta = zram->meta;
+	struct bio *bio;
+	unsigned long blk;
+	int i, added, ret;
+
+	blk = alloc_block_bdev(zram, nr);
+	if (!blk) {
+		ret = -ENOSPC;
+		goto out;
+	}
+
+	bio = bio_alloc(GFP_KERNEL, nr);
+	bio->bi_sector = blk << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_bdev = zram->bdev;
+	for (added = 0; added < nr; added++) {
+		if (bio_add_page(bio, pages[added], PAGE_SIZE, 0) != PAGE_SIZE)
+			break;
+	}
+
+	ret = submit_bio_wait(WRITE, bio);
+	bio_put(bio);
+
+	for (i = 0; i < nr; i++) {
+		u32 index = indexes[i];
+		bool written = !ret && i < added;
+
+		zram_slot_lock(zram, index);
+		if (written && zram_test_flag(meta, index, ZRAM_UNDER_WB)) {
+			zram_free_page(zram, index);
+			zram_set_flag(meta, index, ZRAM_WB);
+			meta->table[index].handle = blk + i;
+			zram_slot_unlock(zram, index);
+			atomic64_inc(&zram->stats.bd_count);
+			atomic64_inc(&zram->stats.bd_writes);
+			continue;
+		}
+		zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+		zram_slot_unlock(zram, index);
+		free_block_bdev(zram, blk + i);
+	}
+
+	return ret;
+
+out:
+	for (i = 0; i < nr; i++) {
+		u32 index = indexes[i];
+
+		zram_slot_lock(zram, index);
+		zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+		zram_slot_unlock(zram, index);
+	}
+	return ret;
+}
+
+static ssize_t writeback_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	struct page *pages[ZRAM_WB_BATCH_PAGES] = { NULL };
+	u32 indexes[ZRAM_WB_BATCH_PAGES];
+	struct zram_meta *meta;
+	unsigned long nr_pages, index;
+	int i, nr = 0;
+	ssize_t ret = 0;
+
+	if (!sysfs_streq(buf, "idle"))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (!zram->backing_dev) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	for (i = 0; i < ZRAM_WB_BATCH_PAGES; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	meta = zram->meta;
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_slot_lock(zram, index);
+		if (!meta->table[index].handle ||
+		    zram_test_flag(meta, index, ZRAM_SAME) ||
+		    zram_test_flag(meta, index, ZRAM_WB) ||
+		    zram_test_flag(meta, index, ZRAM_UNDER_WB) ||
+		    !zram_test_flag(meta, index, ZRAM_IDLE)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+		zram_set_flag(meta, index, ZRAM_UNDER_WB);
+		zram_slot_unlock(zram, index);
+
+		if (zram_decompress_page(zram, page_address(pages[nr]),
+				index)) {
+			zram_slot_lock(zram, index);
+			zram_clear_flag(meta, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+
+		indexes[nr++] = index;
+		if (nr < ZRAM_WB_BATCH_PAGES)
+			continue;
+
+		ret = zram_writeback_pages(zram, pages, indexes, nr);
+		nr = 0;
+		if (ret)
+			break;
+		cond_resched();
+	}
+
+	if (nr)
+		ret = zram_writeback_pages(zram, pages, indexes, nr);
+out:
+	up_read(&zram->init_lock);
+	for (i = 0; i < ZRAM_WB_BATCH_PAGES; i++) {
+		if (pages[i])
+			__free_page(pages[i]);
+	}
+
+	return ret ? ret : len;
+}
+#endif
+
+/*
+ * Recompress slot @index with the secondary algorithm if it matches @mode,
+ * using @buf as a page sized bounce buffer. The new object only replaces
+ * the old one if it is smaller and the slot has not been touched meanwhile.
+ */
+static void zram_recompress_page(struct zram *zram, u32 index, void *buf,
+				 int mode)
+{
+	struct zram_meta *meta = zram->meta;
+	struct zcomp_strm *zstrm;
+	unsigned long handle;
+	unsigned char *cmem;
+	size_t size, clen;
+	bool idle;
+	int ret;
+
+	zram_slot_lock(zram, index);
+	size = zram_get_obj_size(meta, index);
+	idle = zram_test_flag(meta, index, ZRAM_IDLE);
+	if (!meta->table[index].handle ||
+	    zram_test_flag(meta, index, ZRAM_SAME) ||
+	    zram_test_flag(meta, index, ZRAM_DEDUP) ||
+	    zram_test_flag(meta, index, ZRAM_WB) ||
+	    zram_test_flag(meta, index, ZRAM_UNDER_WB) ||
+	    zram_test_flag(meta, index, ZRAM_RECOMP) ||
+	    zram_test_flag(meta, index, ZRAM_UNDER_RECOMP) ||
+	    !(((mode & ZRAM_RECOMP_HUGE) && size == PAGE_SIZE) ||
+	      ((mode & ZRAM_RECOMP_IDLE) && idle))) {
+		zram_slot_unlock(zram, index);
+		return;
+	}
+	zram_set_flag(meta, index, ZRAM_UNDER_RECOMP);
+	zram_slot_unlock(zram, index);
+
+	if (zram_decompress_page(zram, buf, index))
+		goto out;
+
+	zstrm = zcomp_strm_find(zram->recomp);
+	ret = zcomp_compress(zram->recomp, zstrm, buf, &clen);
+	if (ret || clen >= size || clen > max_zpage_size) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		goto out;
+	}
+
+	if (zpool_malloc(meta->mem_pool, clen, __GFP_NORETRY | __GFP_NOWARN,
+			&handle) != 0) {
+		zcomp_strm_release(zram->recomp, zstrm);
+		goto out;
+	}
+
+	cmem = zpool_map_handle(meta->mem_pool, handle, ZPOOL_MM_WO);
+	memcpy(cmem, zstrm->buffer, clen);
+	zpool_unmap_handle(meta->mem_pool, handle);
+	zcomp_strm_release(zram->recomp, zstrm);
+
+	zram_slot_lock(zram, index);
+	if (!zram_test_flag(meta, index, ZRAM_UNDER_RECOMP)) {
+		zram_slot_unlock(zram, index);
+		zpool_free(meta->mem_pool, handle);
+		return;
+	}
+	idle = zram_test_flag(meta, index, ZRAM_IDLE);
+	zram_free_page(zram, index);
+	meta->table[index].handle = handle;
+	zram_set_obj_size(meta, index, clen);
+	zram_set_flag(meta, index, ZRAM_RECOMP);
+	/* the data has not been accessed, keep it eligible for writeback */
+	if (idle)
+		zram_set_flag(meta, index, ZRAM_IDLE);
+	zram_slot_unlock(zram, index);
+
+	atomic64_add(clen, &zram->stats.compr_data_size);
+	atomic64_inc(&zram->stats.pages_stored);
+	atomic64_inc(&zram->stats.recomp_pages);
+	return;
+
+out:
+	zram_slot_lock(zram, index);
+	zram_clear_flag(meta, index, ZRAM_UNDER_RECOMP);
+	zram_slot_unlock(zram, index);
+}
+
+static void zram_recompress_work(struct work_struct *work)
+{
+	struct zram *zram = container_of(work, struct zram, recomp_work);
+	unsigned long nr_pages, index;
+	struct page *page;
+	int mode;
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page)
+		return;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp)
+		goto out;
+
+	mode = ACCESS_ONCE(zram->recomp_mode);
+	nr_pages = zram->disksize >> PAGE_SHIFT;
+	for (index = 0; index < nr_pages; index++) {
+		zram_recompress_page(zram, index, page_address(page), mode);
+		cond_resched();
+	}
+out:
+	up_read(&zram->init_lock);
+	__free_page(page);
+}
+
+/*
+ * Recompress, in the background, the slots which are "huge" (stored
+ * uncompressed), "idle" (see the idle attribute) or either of them for
+ * "huge_idle", with the recomp_algorithm.
+ */
+static ssize_t recompress_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct zram *zram = dev_to_zram(dev);
+	int mode;
+
+	if (sysfs_streq(buf, "huge"))
+		mode = ZRAM_RECOMP_HUGE;
+	else if (sysfs_streq(buf, "idle"))
+		mode = ZRAM_RECOMP_IDLE;
+	else if (sysfs_streq(buf, "huge_idle"))
+		mode = ZRAM_RECOMP_HUGE | ZRAM_RECOMP_IDLE;
+	else
+		return -EINVAL;
+
+	/* pages are only ever marked idle with writeback support */
+	if ((mode & ZRAM_RECOMP_IDLE) && !IS_ENABLED(CONFIG_ZRAM_WRITEBACK))
+		return -EINVAL;
+
+	down_read(&zram->init_lock);
+	if (!init_done(zram) || !zram->recomp) {
+		up_read(&zram->init_lock);
+		return -EINVAL;
+	}
+	zram->recomp_mode = mode;
+	queue_work(system_unbound_wq, &zram->recomp_work);
+	up_read(&zram->init_lock);
+
+	return len;
 }
 
 static void zram_reset_device(struct zram *zram)
 {
 	struct zram_meta *meta;
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp;
 	u64 disksize;
 
+	/* it would block on init_lock until we are done otherwise */
+	cancel_work_sync(&zram->recomp_work);
+
 	down_write(&zram->init_lock);
 
 	zram->limit_pages = 0;
@@ -851,6 +2119,7 @@ static void zram_reset_device(struct zram *zram)
 
 	meta = zram->meta;
 	comp = zram->comp;
+	recomp = zram->recomp;
 	disksize = zram->disksize;
 	/*
 	 * Refcount will go down to 0 eventually and r/w handler
@@ -872,17 +2141,26 @@ static void zram_reset_device(struct zram *zram)
 	set_capacity(zram->disk, 0);
 	part_stat_set_all(&zram->disk->part0, 0);
 
+	/* written back slots are dropped with meta, nothing uses the bitmap */
+	reset_bdev(zram);
+
+	/* a disksize_store() right after up_write() installs its own */
+	zram->comp = NULL;
+	zram->recomp = NULL;
+
 	up_write(&zram->init_lock);
 	/* I/O operation under all of CPU are done so let's free */
 	zram_meta_free(meta, disksize);
 	zcomp_destroy(comp);
+	if (recomp)
+		zcomp_destroy(recomp);
 }
 
 static ssize_t disksize_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t len)
 {
 	u64 disksize;
-	struct zcomp *comp;
+	struct zcomp *comp, *recomp = NULL;
 	struct zram_meta *meta;
 	struct zram *zram = dev_to_zram(dev);
 	int err;
@@ -892,7 +2170,8 @@ static ssize_t disksize_store(struct device *dev,
 		return -EINVAL;
 
 	disksize = PAGE_ALIGN(disksize);
-	meta = zram_meta_alloc(zram->disk->first_minor, disksize);
+	meta = zram_meta_alloc(zram->disk->first_minor, disksize,
+			zram->use_dedup);
 	if (!meta)
 		return -ENOMEM;
 
@@ -904,6 +2183,16 @@ static ssize_t disksize_store(struct device *dev,
 		goto out_free_meta;
 	}
 
+	if (zram->recomp_algorithm[0]) {
+		recomp = zcomp_create(zram->recomp_algorithm, 1);
+		if (IS_ERR(recomp)) {
+			pr_info("Cannot initialise %s recompressing backend\n",
+					zram->recomp_algorithm);
+			err = PTR_ERR(recomp);
+			goto out_free_comp;
+		}
+	}
+
 	down_write(&zram->init_lock);
 	if (init_done(zram)) {
 		pr_info("Cannot change disksize for initialized device\n");
@@ -915,6 +2204,7 @@ static ssize_t disksize_store(struct device *dev,
 	atomic_set(&zram->refcount, 1);
 	zram->meta = meta;
 	zram->comp = comp;
+	zram->recomp = recomp;
 	zram->disksize = disksize;
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 	up_write(&zram->init_lock);
@@ -930,6 +2220,9 @@ static ssize_t disksize_store(struct device *dev,
 
 out_destroy_comp:
 	up_write(&zram->init_lock);
+	if (recomp)
+		zcomp_destroy(recomp);
+out_free_comp:
 	zcomp_destroy(comp);
 out_free_meta:
 	zram_meta_free(meta, disksize);
@@ -982,7 +2275,11 @@ out:
 	return ret;
 }
 
-static void __zram_make_request(struct zram *zram, struct bio *bio)
+/*
+ * Returns true if the bio has been queued to the compression workers, the
+ * caller must not touch it, nor drop its zram_meta reference, any more.
+ */
+static bool __zram_make_request(struct zram *zram, struct bio *bio)
 {
 	int i, offset, rw;
 	u32 index;
@@ -994,10 +2291,24 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 	if (unlikely(bio->bi_rw & REQ_DISCARD)) {
 		zram_bio_discard(zram, index, offset, bio);
 		bio_endio(bio, 0);
-		return;
+		return false;
 	}
 
 	rw = bio_data_dir(bio);
+	if (rw == WRITE && !offset && ACCESS_ONCE(zram->async_comp)) {
+		if (!zram_bio_write_async(zram, index, bio))
+			return true;
+	}
+
+	if (rw == WRITE && !offset) {
+		int ret = zram_bio_write_batched(zram, index, bio);
+
+		if (ret == 0)
+			goto done;
+		if (ret != -EAGAIN)
+			goto out;
+	}
+
 	bio_for_each_segment(bvec, bio, i) {
 		int max_transfer_size = PAGE_SIZE - offset;
 
@@ -1026,12 +2337,14 @@ static void __zram_make_request(struct zram *zram, struct bio *bio)
 		update_position(&index, &offset, bvec);
 	}
 
+done:
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
 	bio_endio(bio, 0);
-	return;
+	return false;
 
 out:
 	bio_io_error(bio);
+	return false;
 }
 
 /*
@@ -1050,8 +2363,8 @@ static void zram_make_request(struct request_queue *queue, struct bio *bio)
 		goto put_zram;
 	}
 
-	__zram_make_request(zram, bio);
-	zram_meta_put(zram);
+	if (!__zram_make_request(zram, bio))
+		zram_meta_put(zram);
 	return;
 put_zram:
 	zram_meta_put(zram);
@@ -1063,14 +2376,12 @@ static void zram_slot_free_notify(struct block_device *bdev,
 				unsigned long index)
 {
 	struct zram *zram;
-	struct zram_meta *meta;
 
 	zram = bdev->bd_disk->private_data;
-	meta = zram->meta;
 
-	bit_spin_lock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
-	bit_spin_unlock(ZRAM_ACCESS, &meta->table[index].value);
+	zram_slot_unlock(zram, index);
 	atomic64_inc(&zram->stats.notify_free);
 }
 
@@ -1092,6 +2403,13 @@ static DEVICE_ATTR(mem_used_max, S_IRUGO | S_IWUSR, mem_used_max_show,
 		mem_used_max_store);
 static DEVICE_ATTR(max_comp_streams, S_IRUGO | S_IWUSR,
 		max_comp_streams_show, max_comp_streams_store);
+static DEVICE_ATTR(recomp_algorithm, S_IRUGO | S_IWUSR,
+		recomp_algorithm_show, recomp_algorithm_store);
+static DEVICE_ATTR(recompress, S_IWUSR, NULL, recompress_store);
+static DEVICE_ATTR(use_dedup, S_IRUGO | S_IWUSR,
+		use_dedup_show, use_dedup_store);
+static DEVICE_ATTR(async_comp, S_IRUGO | S_IWUSR,
+		async_comp_show, async_comp_store);
 static DEVICE_ATTR(comp_algorithm, S_IRUGO | S_IWUSR,
 		comp_algorithm_show, comp_algorithm_store);
 
@@ -1103,11 +2421,16 @@ static ssize_t io_stat_show(struct device *dev,
 
 	down_read(&zram->init_lock);
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8llu\n",
+			"%8llu %8llu %8llu %8llu %8llu %8llu %8llu %8llu %8llu\n",
 			(u64)atomic64_read(&zram->stats.failed_reads),
 			(u64)atomic64_read(&zram->stats.failed_writes),
 			(u64)atomic64_read(&zram->stats.invalid_io),
-			(u64)atomic64_read(&zram->stats.notify_free));
+			(u64)atomic64_read(&zram->stats.notify_free),
+			(u64)atomic64_read(&zram->stats.batched_writes),
+			(u64)atomic64_read(&zram->stats.batched_pages),
+			(u64)atomic64_read(&zram->stats.batched_cycles),
+			(u64)atomic64_read(&zram->stats.single_cycles),
+			(u64)atomic64_read(&zram->stats.async_writes));
 	up_read(&zram->init_lock);
 
 	return ret;
@@ -1118,31 +2441,85 @@ static ssize_t mm_stat_show(struct device *dev,
 {
 	struct zram *zram = dev_to_zram(dev);
 	u64 orig_size, mem_used = 0;
+	unsigned long pages_compacted = 0;
 	long max_used;
 	ssize_t ret;
 
 	down_read(&zram->init_lock);
-	if (init_done(zram))
+	if (init_done(zram)) {
 		mem_used = zpool_get_total_size(zram->meta->mem_pool)
 						>> PAGE_SHIFT;
+		pages_compacted =
+			zpool_get_compacted_pages(zram->meta->mem_pool);
+	}
 
 	orig_size = atomic64_read(&zram->stats.pages_stored);
 	max_used = atomic_long_read(&zram->stats.max_used_pages);
 
 	ret = scnprintf(buf, PAGE_SIZE,
-			"%8llu %8llu %8llu %8lu %8ld %8llu %8llu\n",
+			"%8llu %8llu %8llu %8lu %8ld %8llu %8llu %8llu %8llu %8llu %8lu\n",
 			orig_size << PAGE_SHIFT,
 			(u64)atomic64_read(&zram->stats.compr_data_size),
 			mem_used << PAGE_SHIFT,
 			zram->limit_pages << PAGE_SHIFT,
 			max_used << PAGE_SHIFT,
-			(u64)atomic64_read(&zram->stats.zero_pages),
-			(u64)atomic64_read(&zram->stats.num_migrated));
+			(u64)atomic64_read(&zram->stats.same_pages),
+			(u64)atomic64_read(&zram->stats.num_migrated),
+			(u64)atomic64_read(&zram->stats.dup_data_size),
+			(u64)atomic64_read(&zram->stats.meta_data_size),
+			(u64)atomic64_read(&zram->stats.recomp_pages),
+			pages_compacted);
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+#ifdef CONFIG_ZRAM_WRITEBACK
+static ssize_t bd_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"%8llu %8llu %8llu\n",
+			(u64)atomic64_read(&zram->stats.bd_count),
+			(u64)atomic64_read(&zram->stats.bd_reads),
+			(u64)atomic64_read(&zram->stats.bd_writes));
+	up_read(&zram->init_lock);
+
+	return ret;
+}
+
+static DEVICE_ATTR(backing_dev, S_IRUGO | S_IWUSR,
+		backing_dev_show, backing_dev_store);
+static DEVICE_ATTR(idle, S_IWUSR, NULL, idle_store);
+static DEVICE_ATTR(writeback, S_IWUSR, NULL, writeback_store);
+static DEVICE_ATTR(bd_stat, S_IRUGO, bd_stat_show, NULL);
+#endif
+/*
+ * Counters which only matter when looking into zram's behaviour, the
+ * format may change at any time, hence the version line.
+ */
+static ssize_t debug_stat_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int version = 1;
+	struct zram *zram = dev_to_zram(dev);
+	ssize_t ret;
+
+	down_read(&zram->init_lock);
+	ret = scnprintf(buf, PAGE_SIZE,
+			"version: %d\n%8llu\n",
+			version,
+			(u64)atomic64_read(&zram->stats.slot_lock_contended));
 	up_read(&zram->init_lock);
 
 	return ret;
 }
 
+static DEVICE_ATTR(debug_stat, S_IRUGO, debug_stat_show, NULL);
 static DEVICE_ATTR(io_stat, S_IRUGO, io_stat_show, NULL);
 static DEVICE_ATTR(mm_stat, S_IRUGO, mm_stat_show, NULL);
 ZRAM_ATTR_RO(num_reads);
@@ -1151,9 +2528,19 @@ ZRAM_ATTR_RO(failed_reads);
 ZRAM_ATTR_RO(failed_writes);
 ZRAM_ATTR_RO(invalid_io);
 ZRAM_ATTR_RO(notify_free);
-ZRAM_ATTR_RO(zero_pages);
 ZRAM_ATTR_RO(compr_data_size);
 
+static ssize_t zero_pages_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	struct zram *zram = dev_to_zram(dev);
+
+	deprecated_attr_warn("zero_pages");
+	return scnprintf(buf, PAGE_SIZE, "%llu\n",
+		(u64)atomic64_read(&zram->stats.same_pages));
+}
+static DEVICE_ATTR(zero_pages, S_IRUGO, zero_pages_show, NULL);
+
 static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_disksize.attr,
 	&dev_attr_initstate.attr,
@@ -1172,9 +2559,20 @@ static struct attribute *zram_disk_attrs[] = {
 	&dev_attr_mem_limit.attr,
 	&dev_attr_mem_used_max.attr,
 	&dev_attr_max_comp_streams.attr,
+	&dev_attr_async_comp.attr,
+	&dev_attr_use_dedup.attr,
 	&dev_attr_comp_algorithm.attr,
+	&dev_attr_recomp_algorithm.attr,
+	&dev_attr_recompress.attr,
 	&dev_attr_io_stat.attr,
 	&dev_attr_mm_stat.attr,
+	&dev_attr_debug_stat.attr,
+#ifdef CONFIG_ZRAM_WRITEBACK
+	&dev_attr_backing_dev.attr,
+	&dev_attr_idle.attr,
+	&dev_attr_writeback.attr,
+	&dev_attr_bd_stat.attr,
+#endif
 	NULL,
 };
 
@@ -1188,6 +2586,10 @@ static int create_device(struct zram *zram, int device_id)
 	int ret = -ENOMEM;
 
 	init_rwsem(&zram->init_lock);
+	INIT_WORK(&zram->recomp_work, zram_recompress_work);
+#ifdef CONFIG_ZRAM_WRITEBACK
+	spin_lock_init(&zram->bitmap_lock);
+#endif
 
 	queue = blk_alloc_queue(GFP_KERNEL);
 	if (!queue) {
@@ -1256,6 +2658,7 @@ static int create_device(struct zram *zram, int device_id)
 	strlcpy(zram->compressor, default_compressor, sizeof(zram->compressor));
 	zram->meta = NULL;
 	zram->max_comp_streams = 1;
+	zram->async_comp = false;
 	return 0;
 
 out_free_disk:
@@ -1303,17 +2706,26 @@ static int __init zram_init(void)
 		return -EINVAL;
 	}
 
+#ifdef CONFIG_ZRAM_WRITEBACK
+	zram_bdev_wq = alloc_workqueue("zram_bdev",
+			WQ_MEM_RECLAIM | WQ_UNBOUND, 0);
+	if (!zram_bdev_wq)
+		return -ENOMEM;
+#endif
+
 	zram_major = register_blkdev(0, "zram");
 	if (zram_major <= 0) {
 		pr_warn("Unable to get major number\n");
-		return -EBUSY;
+		ret = -EBUSY;
+		goto out_wq;
 	}
 
 	/* Allocate the device array and initialize each one */
 	zram_devices = kzalloc(num_devices * sizeof(struct zram), GFP_KERNEL);
 	if (!zram_devices) {
 		unregister_blkdev(zram_major, "zram");
-		return -ENOMEM;
+		ret = -ENOMEM;
+		goto out_wq;
 	}
 
 	for (dev_id = 0; dev_id < num_devices; dev_id++) {
@@ -1322,18 +2734,29 @@ static int __init zram_init(void)
 			goto out_error;
 	}
 
+	if (zram_comp_workers_init())
+		pr_warn("Unable to start compression workers\n");
+
 	show_mem_notifier_register(&zram_show_mem_notifier_block);
 	pr_info("Created %u device(s)\n", num_devices);
 	return 0;
 
 out_error:
 	destroy_devices(dev_id);
+out_wq:
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_bdev_wq);
+#endif
 	return ret;
 }
 
 static void __exit zram_exit(void)
 {
 	destroy_devices(num_devices);
+	zram_comp_workers_destroy();
+#ifdef CONFIG_ZRAM_WRITEBACK
+	destroy_workqueue(zram_bdev_wq);
+#endif
 }
 
 module_init(zram_init);
@@ -21,9 +21,11 @@
 #define _ZRAM_DRV_H_
 
 #include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <linux/zpool.h>
 
 #include "zcomp.h"
+#include "zram_dedup.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -70,9 +72,18 @@ static const size_t max_zpage_size = PAGE_SIZE / 10 * 9;
 
 /* Flags for zram pages (table[page_no].value) */
 enum zram_pageflags {
-	/* Page consists entirely of zeros */
-	ZRAM_ZERO = ZRAM_FLAG_SHIFT,
+	/*
+	 * Page is filled with one repeated word, kept in table.handle
+	 * instead of a zpool object.
+	 */
+	ZRAM_SAME = ZRAM_FLAG_SHIFT,
 	ZRAM_ACCESS,	/* page is now accessed */
+	ZRAM_DEDUP,	/* table.handle points to a struct zram_entry */
+	ZRAM_IDLE,	/* not accessed since last marked idle */
+	ZRAM_WB,	/* page is stored on the backing device */
+	ZRAM_UNDER_WB,	/* page is being written back */
+	ZRAM_RECOMP,	/* compressed with the secondary algorithm */
+	ZRAM_UNDER_RECOMP,	/* page is being recompressed */
 
 	__NR_ZRAM_PAGEFLAGS,
 };
@@ -81,8 +92,12 @@ enum zram_pageflags {
 
 /* Allocated for each disk page */
 struct zram_table_entry {
+	/* block index on the backing device for ZRAM_WB pages */
 	unsigned long handle;
 	unsigned long value;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	unsigned long ac_time;	/* jiffies at last access */
+#endif
 };
 
 struct zram_stats {
@@ -94,19 +109,76 @@ struct zram_stats {
 	atomic64_t failed_writes;	/* can happen when memory is too low */
 	atomic64_t invalid_io;	/* non-page-aligned I/O requests */
 	atomic64_t notify_free;	/* no. of swap slot free notifications */
-	atomic64_t zero_pages;		/* no. of zero filled pages */
+	atomic64_t same_pages;		/* no. of same element filled pages */
 	atomic64_t pages_stored;	/* no. of pages currently stored */
 	atomic_long_t max_used_pages;	/* no. of maximum pages stored */
+	atomic64_t batched_writes;	/* no. of batches written */
+	atomic64_t batched_pages;	/* no. of pages written in batches */
+	atomic64_t batched_cycles;	/* cycles spent in batched writes */
+	atomic64_t single_cycles;	/* cycles spent in per-page writes */
+	atomic64_t async_writes;	/* no. of bios handed to workers */
+	atomic64_t dup_data_size;	/* compressed bytes saved by dedup */
+	atomic64_t meta_data_size;	/* size of the dedup entries */
+	atomic64_t recomp_pages;	/* no. of recompressed pages */
+	atomic64_t slot_lock_contended;	/* no. of busy slot locks */
+#ifdef CONFIG_ZRAM_WRITEBACK
+	atomic64_t bd_count;		/* no. of pages in backing device */
+	atomic64_t bd_reads;		/* no. of reads from backing device */
+	atomic64_t bd_writes;		/* no. of writes to backing device */
+#endif
+};
+
+/*
+ * Asynchronous compression: a write bio is cut into chunks of up to
+ * ZCOMP_BATCH_PAGES pages which are spread over the compression workers.
+ * The bio is completed by whichever worker stores the last chunk.
+ */
+struct zram_bio_ctx {
+	struct zram *zram;
+	struct bio *bio;
+	atomic_t pending;	/* chunks not stored yet */
+	int error;
+};
+
+struct zram_work {
+	struct list_head list;
+	struct zram_bio_ctx *ctx;
+	struct page *pages[ZCOMP_BATCH_PAGES];
+	int nr_pages;
+	u32 index;
+	/* submitter was in reclaim, see zram_comp_worker_fn() */
+	bool memalloc;
+};
+
+struct zram_comp_worker {
+	spinlock_t lock;
+	struct list_head works;
+	wait_queue_head_t wait;
+	struct task_struct *task;
 };
 
 struct zram_meta {
 	struct zram_table_entry *table;
 	struct zpool *mem_pool;
+	/* dedup hash table, NULL if dedup is not used */
+	struct zram_hash *hash;
+	size_t hash_size;
 };
 
+static inline bool zram_dedup_enabled(struct zram_meta *meta)
+{
+	return meta->hash;
+}
+
+/* Which slots the recompress attribute picks */
+#define ZRAM_RECOMP_HUGE	BIT(0)
+#define ZRAM_RECOMP_IDLE	BIT(1)
+
 struct zram {
 	struct zram_meta *meta;
 	struct zcomp *comp;
+	/* secondary algorithm, NULL if no recomp_algorithm is set */
+	struct zcomp *recomp;
 	struct gendisk *disk;
 	/* Prevent concurrent execution of device init */
 	struct rw_semaphore init_lock;
@@ -115,6 +187,10 @@ struct zram {
 	 */
 	unsigned long limit_pages;
 	int max_comp_streams;
+	/* hand full page writes over to the compression workers */
+	bool async_comp;
+	/* deduplicate objects of the next initialised meta */
+	bool use_dedup;
 
 	struct zram_stats stats;
 	atomic_t refcount; /* refcount for zram_meta */
@@ -126,5 +202,17 @@ struct zram {
 	 */
 	u64 disksize;	/* bytes */
 	char compressor[10];
+	char recomp_algorithm[10];
+	/* background recompression of the slots selected by recomp_mode */
+	struct work_struct recomp_work;
+	int recomp_mode;
+#ifdef CONFIG_ZRAM_WRITEBACK
+	struct file *backing_dev;
+	struct block_device *bdev;
+	/* allocated blocks of the backing device, protected by bitmap_lock */
+	unsigned long *bitmap;
+	unsigned long nr_pages;
+	spinlock_t bitmap_lock;
+#endif
 };
 #endif
@@ -53,7 +53,15 @@ struct cpufreq_interactive_policyinfo {
 	struct timer_list policy_timer;
 	struct timer_list policy_slack_timer;
 	struct hrtimer notif_timer;
-	spinlock_t load_lock; /* protects load tracking stat */
+	/*
+	 * Frequency x time integral of the policy, in kHz * us. Only the
+	 * transition notifier writes it, the policy timer reads it without
+	 * taking any lock.
+	 */
+	seqcount_t freq_seq;
+	u64 freq_integral;
+	u64 freq_stamp;
+	unsigned int freq_cur;
 	u64 last_evaluated_jiffy;
 	struct cpufreq_policy *policy;
 	struct cpufreq_policy p_nolim; /* policy copy with no limits */
@@ -74,22 +82,28 @@ struct cpufreq_interactive_policyinfo {
 	unsigned long *cpu_busy_times;
 };
 
-/* Protected by per-policy load_lock */
+/*
+ * Only ever written by the policy timer, or with the timers stopped under
+ * enable_sem, so it needs no lock.
+ */
 struct cpufreq_interactive_cpuinfo {
 	u64 time_in_idle;
 	u64 time_in_idle_timestamp;
 	u64 cputime_speedadj;
 	u64 cputime_speedadj_timestamp;
+	u64 freq_integral;
 	unsigned int loadadjfreq;
 };
 
 static DEFINE_PER_CPU(struct cpufreq_interactive_policyinfo *, polinfo);
 static DEFINE_PER_CPU(struct cpufreq_interactive_cpuinfo, cpuinfo);
 
-/* realtime thread handles frequency scaling */
+/*
+ * realtime thread handles frequency scaling; bits in speedchange_cpumask
+ * are set and cleared atomically.
+ */
 static struct task_struct *speedchange_task;
 static cpumask_t speedchange_cpumask;
-static spinlock_t speedchange_cpumask_lock;
 static struct mutex gov_lock;
 
 static int set_window_count;
@@ -203,43 +217,63 @@ static inline int set_window_helper(
 			 usecs_to_jiffies(tunables->timer_rate));
 }
 
+static u64 policy_freq_integral(struct cpufreq_interactive_policyinfo *ppol,
+				u64 now)
+{
+	unsigned int seq;
+	u64 integral;
+
+	do {
+		seq = read_seqcount_begin(&ppol->freq_seq);
+		integral = ppol->freq_integral;
+		if (now > ppol->freq_stamp)
+			integral += (now - ppol->freq_stamp) * ppol->freq_cur;
+	} while (read_seqcount_retry(&ppol->freq_seq, seq));
+
+	return integral;
+}
+
+static void reset_cpu_load(struct cpufreq_interactive_policyinfo *ppol,
+			   int cpu)
+{
+	struct cpufreq_interactive_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+	struct cpufreq_interactive_tunables *tunables =
+		ppol->policy->governor_data;
+
+	pcpu->time_in_idle = get_cpu_idle_time(cpu,
+					&pcpu->time_in_idle_timestamp,
+					tunables->io_is_busy);
+	pcpu->cputime_speedadj = 0;
+	pcpu->cputime_speedadj_timestamp = pcpu->time_in_idle_timestamp;
+	pcpu->freq_integral = policy_freq_integral(ppol,
+					pcpu->time_in_idle_timestamp);
+}
+
+/*
+ * With slack_only false this must be called from the policy timer itself,
+ * which is what keeps the per-cpu load stats single-writer.
+ */
 static void cpufreq_interactive_timer_resched(unsigned long cpu,
 					      bool slack_only)
 {
 	struct cpufreq_interactive_policyinfo *ppol = per_cpu(polinfo, cpu);
-	struct cpufreq_interactive_cpuinfo *pcpu;
 	struct cpufreq_interactive_tunables *tunables =
 		ppol->policy->governor_data;
 	u64 expires;
-	unsigned long flags;
 	int i;
 
-	spin_lock_irqsave(&ppol->load_lock, flags);
 	expires = round_to_nw_start(ppol->last_evaluated_jiffy, tunables);
 	if (!slack_only) {
-		for_each_cpu(i, ppol->policy->cpus) {
-			pcpu = &per_cpu(cpuinfo, i);
-			pcpu->time_in_idle = get_cpu_idle_time(i,
-						&pcpu->time_in_idle_timestamp,
-						tunables->io_is_busy);
-			pcpu->cputime_speedadj = 0;
-			pcpu->cputime_speedadj_timestamp =
-						pcpu->time_in_idle_timestamp;
-		}
-		del_timer(&ppol->policy_timer);
-		ppol->policy_timer.expires = expires;
-		add_timer(&ppol->policy_timer);
+		for_each_cpu(i, ppol->policy->cpus)
+			reset_cpu_load(ppol, i);
+		mod_timer(&ppol->policy_timer, expires);
 	}
 
 	if (tunables->timer_slack_val >= 0 &&
 	    ppol->target_freq > ppol->policy->min) {
 		expires += usecs_to_jiffies(tunables->timer_slack_val);
-		del_timer(&ppol->policy_slack_timer);
-		ppol->policy_slack_timer.expires = expires;
-		add_timer(&ppol->policy_slack_timer);
+		mod_timer(&ppol->policy_slack_timer, expires);
 	}
-
-	spin_unlock_irqrestore(&ppol->load_lock, flags);
 }
 
 /* The caller shall take enable_sem write semaphore to avoid any timer race.
@@ -250,12 +284,15 @@ static void cpufreq_interactive_timer_start(
 	struct cpufreq_interactive_tunables *tunables, int cpu)
 {
 	struct cpufreq_interactive_policyinfo *ppol = per_cpu(polinfo, cpu);
-	struct cpufreq_interactive_cpuinfo *pcpu;
 	u64 expires = round_to_nw_start(ppol->last_evaluated_jiffy, tunables);
-	unsigned long flags;
 	int i;
 
-	spin_lock_irqsave(&ppol->load_lock, flags);
+	ppol->freq_integral = 0;
+	ppol->freq_stamp = ktime_to_us(ktime_get());
+	ppol->freq_cur = ppol->policy->cur;
+	for_each_cpu(i, ppol->policy->cpus)
+		reset_cpu_load(ppol, i);
+
 	ppol->policy_timer.expires = expires;
 	add_timer(&ppol->policy_timer);
 	if (tunables->timer_slack_val >= 0 &&
@@ -264,16 +301,6 @@ static void cpufreq_interactive_timer_start(
 		ppol->policy_slack_timer.expires = expires;
 		add_timer(&ppol->policy_slack_timer);
 	}
-
-	for_each_cpu(i, ppol->policy->cpus) {
-		pcpu = &per_cpu(cpuinfo, i);
-		pcpu->time_in_idle =
-			get_cpu_idle_time(i, &pcpu->time_in_idle_timestamp,
-					  tunables->io_is_busy);
-		pcpu->cputime_speedadj = 0;
-		pcpu->cputime_speedadj_timestamp = pcpu->time_in_idle_timestamp;
-	}
-	spin_unlock_irqrestore(&ppol->load_lock, flags);
 }
 
 static unsigned int freq_to_above_hispeed_delay(
@@ -433,6 +460,7 @@ static u64 update_load(int cpu)
 	unsigned int delta_idle;
 	unsigned int delta_time;
 	u64 active_time;
+	u64 integral, avg_freq;
 
 	now_idle = get_cpu_idle_time(cpu, &now, tunables->io_is_busy);
 	delta_idle = (unsigned int)(now_idle - pcpu->time_in_idle);
@@ -443,8 +471,20 @@ static u64 update_load(int cpu)
 	else
 		active_time = delta_time - delta_idle;
 
-	pcpu->cputime_speedadj += active_time * ppol->policy->cur;
+	/*
+	 * Weight the active time with the mean frequency of the interval
+	 * rather than splitting it at every transition: the notifier then
+	 * never has to touch per-cpu state.
+	 */
+	integral = policy_freq_integral(ppol, now);
+	if (delta_time)
+		avg_freq = div64_u64(integral - pcpu->freq_integral,
+				     delta_time);
+	else
+		avg_freq = ppol->policy->cur;
+	pcpu->cputime_speedadj += active_time * avg_freq;
 
+	pcpu->freq_integral = integral;
 	pcpu->time_in_idle = now_idle;
 	pcpu->time_in_idle_timestamp = now;
 	return now;
@@ -477,7 +517,6 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	fcpu = cpumask_first(ppol->policy->related_cpus);
 	now = ktime_to_us(ktime_get());
-	spin_lock_irqsave(&ppol->load_lock, flags);
 
 	skip_hispeed_logic = tunables->ignore_hispeed_on_notif &&
 						ppol->notif_pending;
@@ -514,7 +553,6 @@ static void cpufreq_interactive_timer(unsigned long data)
 			max_cpu = i;
 		}
 	}
-	spin_unlock_irqrestore(&ppol->load_lock, flags);
 
 	/*
 	 * Send govinfo notification.
@@ -627,8 +665,13 @@ static void cpufreq_interactive_timer(unsigned long data)
 	if (new_freq >= ppol->policy->max && !policy_max_fast_restore)
 		ppol->max_freq_hyst_start_time = now;
 
+	/*
+	 * Only bother the speedchange task when the target moves or the
+	 * policy has not reached it yet, so that a failed or skipped change
+	 * is retried on the next sample.
+	 */
 	if (ppol->target_freq == new_freq &&
-			ppol->target_freq <= ppol->policy->cur) {
+	    ppol->policy->cur == new_freq) {
 		trace_cpufreq_interactive_already(
 			max_cpu, cpu_load, ppol->target_freq,
 			ppol->policy->cur, new_freq);
@@ -641,9 +684,7 @@ static void cpufreq_interactive_timer(unsigned long data)
 
 	ppol->target_freq = new_freq;
 	spin_unlock_irqrestore(&ppol->target_freq_lock, flags);
-	spin_lock_irqsave(&speedchange_cpumask_lock, flags);
 	cpumask_set_cpu(max_cpu, &speedchange_cpumask);
-	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
 	wake_up_process(speedchange_task);
 
 rearm:
@@ -658,31 +699,29 @@ exit:
 static int cpufreq_interactive_speedchange_task(void *data)
 {
 	unsigned int cpu;
-	cpumask_t tmp_mask;
-	unsigned long flags;
 	struct cpufreq_interactive_policyinfo *ppol;
 
 	while (1) {
+		/*
+		 * Wakers set their bit before wake_up_process(), which orders
+		 * against the state change here: no request can be missed.
+		 */
 		set_current_state(TASK_INTERRUPTIBLE);
-		spin_lock_irqsave(&speedchange_cpumask_lock, flags);
 
 		if (cpumask_empty(&speedchange_cpumask)) {
-			spin_unlock_irqrestore(&speedchange_cpumask_lock,
-					       flags);
 			schedule();
 
 			if (kthread_should_stop())
 				break;
-
-			spin_lock_irqsave(&speedchange_cpumask_lock, flags);
 		}
 
 		set_current_state(TASK_RUNNING);
-		tmp_mask = speedchange_cpumask;
-		cpumask_clear(&speedchange_cpumask);
-		spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
 
-		for_each_cpu(cpu, &tmp_mask) {
+		for_each_cpu(cpu, &speedchange_cpumask) {
+			if (!cpumask_test_and_clear_cpu(cpu,
+							&speedchange_cpumask))
+				continue;
+
 			ppol = per_cpu(polinfo, cpu);
 			if (!down_read_trylock(&ppol->enable_sem))
 				continue;
@@ -709,19 +748,17 @@ static void cpufreq_interactive_boost(struct cpufreq_interactive_tunables *tunab
 {
 	int i;
 	int anyboost = 0;
-	unsigned long flags[2];
+	unsigned long flags;
 	struct cpufreq_interactive_policyinfo *ppol;
 
 	tunables->boosted = true;
 
-	spin_lock_irqsave(&speedchange_cpumask_lock, flags[0]);
-
 	for_each_online_cpu(i) {
 		ppol = per_cpu(polinfo, i);
 		if (!ppol || tunables != ppol->policy->governor_data)
 			continue;
 
-		spin_lock_irqsave(&ppol->target_freq_lock, flags[1]);
+		spin_lock_irqsave(&ppol->target_freq_lock, flags);
 		if (ppol->target_freq < tunables->hispeed_freq) {
 			ppol->target_freq = tunables->hispeed_freq;
 			cpumask_set_cpu(i, &speedchange_cpumask);
@@ -737,12 +774,10 @@ static void cpufreq_interactive_boost(struct cpufreq_interactive_tunables *tunab
 
 		ppol->floor_freq = tunables->hispeed_freq;
 		ppol->floor_validate_time = ktime_to_us(ktime_get());
-		spin_unlock_irqrestore(&ppol->target_freq_lock, flags[1]);
+		spin_unlock_irqrestore(&ppol->target_freq_lock, flags);
 		break;
 	}
 
-	spin_unlock_irqrestore(&speedchange_cpumask_lock, flags[0]);
-
 	if (anyboost)
 		wake_up_process(speedchange_task);
 }
@@ -794,9 +829,11 @@ static enum hrtimer_restart cpufreq_interactive_hrtimer(struct hrtimer *timer)
 	}
 	cpu = ppol->notif_cpu;
 	trace_cpufreq_interactive_load_change(cpu);
-	del_timer(&ppol->policy_timer);
-	del_timer(&ppol->policy_slack_timer);
-	cpufreq_interactive_timer(cpu);
+	/*
+	 * Evaluate from the policy timer rather than from here, so that the
+	 * load stats keep a single writer.
+	 */
+	mod_timer(&ppol->policy_timer, jiffies);
 
 	up_read(&ppol->enable_sem);
 	return HRTIMER_NORESTART;
@@ -811,8 +848,8 @@ static int cpufreq_interactive_notifier(
 {
 	struct cpufreq_freqs *freq = data;
 	struct cpufreq_interactive_policyinfo *ppol;
-	int cpu;
 	unsigned long flags;
+	u64 now;
 
 	if (val == CPUFREQ_POSTCHANGE) {
 		ppol = per_cpu(polinfo, freq->cpu);
@@ -829,10 +866,17 @@ static int cpufreq_interactive_notifier(
 			up_read(&ppol->enable_sem);
 			return 0;
 		}
-		spin_lock_irqsave(&ppol->load_lock, flags);
-		for_each_cpu(cpu, ppol->policy->cpus)
-			update_load(cpu);
-		spin_unlock_irqrestore(&ppol->load_lock, flags);
+		/* Keep the policy timer from spinning on us on this cpu */
+		local_irq_save(flags);
+		now = ktime_to_us(ktime_get());
+		write_seqcount_begin(&ppol->freq_seq);
+		if (now > ppol->freq_stamp)
+			ppol->freq_integral +=
+				(now - ppol->freq_stamp) * ppol->freq_cur;
+		ppol->freq_stamp = now;
+		ppol->freq_cur = freq->new;
+		write_seqcount_end(&ppol->freq_seq);
+		local_irq_restore(flags);
 
 		up_read(&ppol->enable_sem);
 	}
@@ -1566,7 +1610,7 @@ static struct cpufreq_interactive_policyinfo *get_policyinfo(
 	ppol->policy_slack_timer.function = cpufreq_interactive_nop_timer;
 	hrtimer_init(&ppol->notif_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	ppol->notif_timer.function = cpufreq_interactive_hrtimer;
-	spin_lock_init(&ppol->load_lock);
+	seqcount_init(&ppol->freq_seq);
 	spin_lock_init(&ppol->target_freq_lock);
 	init_rwsem(&ppol->enable_sem);
 
@@ -1783,7 +1827,6 @@ static int __init cpufreq_interactive_init(void)
 {
 	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
 
-	spin_lock_init(&speedchange_cpumask_lock);
 	mutex_init(&gov_lock);
 	mutex_init(&sched_lock);
 	speedchange_task =
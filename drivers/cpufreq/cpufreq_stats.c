@@ -17,6 +17,9 @@
 #include <linux/slab.h>
 #include <linux/sort.h>
 #include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/cpufreq_stats.h>
 #include <asm/cputime.h>
 
 static spinlock_t cpufreq_stats_lock;
@@ -63,6 +66,168 @@ struct cpufreq_stats_attribute {
 	ssize_t(*show) (struct cpufreq_stats *, char *);
 };
 
+#ifdef CONFIG_CPU_FREQ_STAT_RING
+/*
+ * Per-cpu binary ring of transition events for userspace profilers, see
+ * include/uapi/linux/cpufreq_stats.h for the layout and read protocol.
+ * Rings are allocated for every possible cpu at init and live until exit,
+ * so a mapping survives hotplug and policy teardown.
+ */
+#define TRANS_RING_SIZE		(8 * PAGE_SIZE)
+
+struct trans_ring {
+	struct cpufreq_trans_ring_hdr *hdr;
+	atomic64_t head;
+	char governor[CPUFREQ_TRANS_GOV_LEN];
+};
+
+static DEFINE_PER_CPU(struct trans_ring, trans_ring);
+
+/*
+ * Lockless: a writer claims its slot with one atomic increment, then
+ * invalidates, fills and publishes it. Transitions of a cpu are normally
+ * serialized by its policy, so the increment is uncontended.
+ */
+static void trans_ring_record(struct cpufreq_freqs *freq)
+{
+	struct trans_ring *ring = &per_cpu(trans_ring, freq->cpu);
+	struct cpufreq_trans_ring_hdr *hdr = ACCESS_ONCE(ring->hdr);
+	struct cpufreq_trans_event *entries;
+	struct cpufreq_trans_event *e;
+	u64 seq, slot;
+
+	if (!hdr)
+		return;
+
+	/* pairs with the smp_wmb() publishing hdr in trans_ring_create() */
+	smp_read_barrier_depends();
+	entries = (struct cpufreq_trans_event *)(hdr + 1);
+
+	seq = atomic64_inc_return(&ring->head);
+	slot = seq - 1;
+	e = &entries[do_div(slot, hdr->nr_entries)];
+
+	ACCESS_ONCE(e->seq) = 0;
+	smp_wmb();
+	e->time_ns = ktime_to_ns(ktime_get());
+	e->cpu = freq->cpu;
+	e->old_freq = freq->old;
+	e->new_freq = freq->new;
+	e->flags = freq->flags;
+	memcpy(e->governor, ring->governor, sizeof(e->governor));
+	smp_wmb();
+	ACCESS_ONCE(e->seq) = seq;
+	ACCESS_ONCE(hdr->head) = atomic64_read(&ring->head);
+}
+
+static void trans_ring_set_governor(struct cpufreq_policy *policy)
+{
+	unsigned int cpu;
+
+	for_each_cpu(cpu, policy->related_cpus)
+		strlcpy(per_cpu(trans_ring, cpu).governor,
+			policy->governor ? policy->governor->name : "",
+			CPUFREQ_TRANS_GOV_LEN);
+}
+
+static ssize_t trans_ring_read(struct file *filp, struct kobject *kobj,
+			       struct bin_attribute *attr, char *buf,
+			       loff_t off, size_t count)
+{
+	struct trans_ring *ring = &per_cpu(trans_ring, kobj_to_dev(kobj)->id);
+
+	return memory_read_from_buffer(buf, count, &off, ring->hdr,
+				       TRANS_RING_SIZE);
+}
+
+static int trans_ring_mmap(struct file *filp, struct kobject *kobj,
+			   struct bin_attribute *attr,
+			   struct vm_area_struct *vma)
+{
+	struct trans_ring *ring = &per_cpu(trans_ring, kobj_to_dev(kobj)->id);
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	return remap_vmalloc_range(vma, ring->hdr, vma->vm_pgoff);
+}
+
+static struct bin_attribute trans_ring_attr = {
+	.attr	= { .name = "cpufreq_trans_ring", .mode = 0444 },
+	.size	= TRANS_RING_SIZE,
+	.read	= trans_ring_read,
+	.mmap	= trans_ring_mmap,
+};
+
+static void trans_ring_free(void)
+{
+	struct trans_ring *ring;
+	struct device *dev;
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ring = &per_cpu(trans_ring, cpu);
+		if (!ring->hdr)
+			continue;
+
+		dev = get_cpu_device(cpu);
+		if (dev)
+			sysfs_remove_bin_file(&dev->kobj, &trans_ring_attr);
+		vfree(ring->hdr);
+		ring->hdr = NULL;
+	}
+}
+
+/*
+ * Called before the transition notifier is registered, so no recorder can
+ * be running yet and a ring whose file failed can be freed right away.
+ */
+static void trans_ring_create(void)
+{
+	struct cpufreq_trans_ring_hdr *hdr;
+	struct trans_ring *ring;
+	struct device *dev;
+	unsigned int cpu;
+
+	BUILD_BUG_ON(sizeof(*hdr) != sizeof(struct cpufreq_trans_event));
+
+	for_each_possible_cpu(cpu) {
+		dev = get_cpu_device(cpu);
+		if (!dev)
+			continue;
+
+		hdr = vmalloc_user(TRANS_RING_SIZE);
+		if (!hdr) {
+			pr_warn("Cannot allocate cpufreq transition ring\n");
+			break;
+		}
+
+		hdr->version = CPUFREQ_TRANS_RING_VERSION;
+		hdr->entry_size = sizeof(struct cpufreq_trans_event);
+		hdr->nr_entries = TRANS_RING_SIZE / hdr->entry_size - 1;
+		hdr->cpu = cpu;
+
+		ring = &per_cpu(trans_ring, cpu);
+		atomic64_set(&ring->head, 0);
+		/* the header has to be complete before a recorder sees it */
+		smp_wmb();
+		ring->hdr = hdr;
+
+		if (sysfs_create_bin_file(&dev->kobj, &trans_ring_attr)) {
+			pr_warn("Cannot create cpufreq transition ring file\n");
+			ring->hdr = NULL;
+			vfree(hdr);
+		}
+	}
+}
+#else
+static inline void trans_ring_record(struct cpufreq_freqs *freq) { }
+static inline void trans_ring_set_governor(struct cpufreq_policy *policy) { }
+static inline void trans_ring_create(void) { }
+static inline void trans_ring_free(void) { }
+#endif
+
 static int cpufreq_stats_update(unsigned int cpu)
 {
 	struct cpufreq_stats *stat;
@@ -602,6 +767,9 @@ static int cpufreq_stat_notifier_policy(struct notifier_block *nb,
 		return 0;
 	}
 
+	if (val == CPUFREQ_NOTIFY)
+		trans_ring_set_governor(policy);
+
 	table = cpufreq_frequency_get_table(cpu);
 	if (!table)
 		return 0;
@@ -675,6 +843,8 @@ static int cpufreq_stat_notifier_trans(struct notifier_block *nb,
 	if (val != CPUFREQ_POSTCHANGE)
 		return 0;
 
+	trans_ring_record(freq);
+
 	stat = per_cpu(cpufreq_stats_table, freq->cpu);
 	if (!stat)
 		return 0;
@@ -725,6 +895,9 @@ static int __init cpufreq_stats_init(void)
 	for_each_online_cpu(cpu)
 		cpufreq_stats_create_table(cpu);
 
+	/* rings have to be in place before the first transition is recorded */
+	trans_ring_create();
+
 	ret = cpufreq_register_notifier(&notifier_trans_block,
 				CPUFREQ_TRANSITION_NOTIFIER);
 	if (ret) {
@@ -733,6 +906,7 @@ static int __init cpufreq_stats_init(void)
 		for_each_online_cpu(cpu)
 			cpufreq_stats_free_table(cpu);
 		free_all_freq_table();
+		trans_ring_free();
 		return ret;
 	}
 
@@ -758,6 +932,7 @@ static void __exit cpufreq_stats_exit(void)
 		cpufreq_stats_free_table(cpu);
 	cpufreq_allstats_free();
 	cpufreq_powerstats_free();
+	trans_ring_free();
 }
 MODULE_AUTHOR("Zou Nan hai <nanhai.zou@intel.com>");
 MODULE_DESCRIPTION("'cpufreq_stats' - A driver to export cpufreq stats "
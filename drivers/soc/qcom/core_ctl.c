@@ -45,13 +45,29 @@
 
 #define MAX_CPUS_PER_GROUP 4
 
+/*
+ * CPUs are parked by isolating them from the scheduler rather than taking
+ * them offline: an isolated CPU keeps its per-cpu state and only stops
+ * receiving tasks, so parking and unparking it costs a cpumask update and
+ * one stopper run instead of a full hotplug cycle.
+ *
+ * "busy" is the runqueue depth of a CPU in hundredths of a task, predicted
+ * one poll period ahead from the scheduler's decayed nr_running average.
+ * The thresholds compared against it are exported as busy_up_nr_thres and
+ * busy_down_nr_thres; the old percent-load busy_*_thres files are gone so
+ * that stale userspace tunings fail loudly instead of meaning 0.6 tasks.
+ *
+ * CPU0 is never isolated: the boot-time timers, irqs and pinned work that
+ * isolation does not migrate live there.
+ */
 struct cpu_data {
 	/* Per CPU data. */
 	bool	inited;
 	bool	online;
-	bool	rejected;
+	bool	isolated;
 	bool	is_busy;
 	unsigned int busy;
+	unsigned int nr_avg;
 	unsigned int cpu;
 	struct list_head sib;
 
@@ -59,11 +75,11 @@ struct cpu_data {
 	unsigned int min_cpus;
 	unsigned int max_cpus;
 	unsigned int offline_delay_ms;
+	unsigned int poll_ms;
 	unsigned int additional_cpus;
 	unsigned int busy_up_thres[MAX_CPUS_PER_GROUP];
 	unsigned int busy_down_thres[MAX_CPUS_PER_GROUP];
-	unsigned int online_cpus;
-	unsigned int avail_cpus;
+	unsigned int active_cpus;
 	unsigned int num_cpus;
 	unsigned int need_cpus;
 	s64 need_ts;
@@ -72,14 +88,15 @@ struct cpu_data {
 	bool pending;
 	spinlock_t pending_lock;
 	struct timer_list timer;
-	struct task_struct *hotplug_thread;
+	struct timer_list poll_timer;
+	struct task_struct *core_ctl_thread;
 	struct kobject kobj;
 };
 
 static DEFINE_PER_CPU(struct cpu_data, cpu_state);
 static DEFINE_SPINLOCK(state_lock);
 static void apply_need(struct cpu_data *f);
-static void wake_up_hotplug_thread(struct cpu_data *state);
+static void wake_up_core_ctl_thread(struct cpu_data *state);
 
 /* ========================= sysfs interface =========================== */
 
@@ -92,7 +109,7 @@ static ssize_t store_min_cpus(struct cpu_data *state,
 		return -EINVAL;
 
 	state->min_cpus = min(val, state->max_cpus);
-	wake_up_hotplug_thread(state);
+	wake_up_core_ctl_thread(state);
 
 	return count;
 }
@@ -113,7 +130,7 @@ static ssize_t store_max_cpus(struct cpu_data *state,
 	val = min(val, state->num_cpus);
 	state->max_cpus = val;
 	state->min_cpus = min(state->min_cpus, state->max_cpus);
-	wake_up_hotplug_thread(state);
+	wake_up_core_ctl_thread(state);
 
 	return count;
 }
@@ -162,7 +179,29 @@ static ssize_t show_offline_delay_ms(struct cpu_data *state, char *buf)
 	return snprintf(buf, PAGE_SIZE, "%u\n", state->offline_delay_ms);
 }
 
-static ssize_t store_busy_up_thres(struct cpu_data *state,
+static ssize_t store_poll_ms(struct cpu_data *state,
+				const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (sscanf(buf, "%u\n", &val) != 1)
+		return -EINVAL;
+
+	if (!val)
+		return -EINVAL;
+
+	state->poll_ms = val;
+	mod_timer(&state->poll_timer, jiffies + msecs_to_jiffies(val));
+
+	return count;
+}
+
+static ssize_t show_poll_ms(struct cpu_data *state, char *buf)
+{
+	return snprintf(buf, PAGE_SIZE, "%u\n", state->poll_ms);
+}
+
+static ssize_t store_busy_up_nr_thres(struct cpu_data *state,
 					const char *buf, size_t count)
 {
 	unsigned int val[MAX_CPUS_PER_GROUP];
@@ -183,7 +222,7 @@ static ssize_t store_busy_up_thres(struct cpu_data *state,
 	return count;
 }
 
-static ssize_t show_busy_up_thres(struct cpu_data *state, char *buf)
+static ssize_t show_busy_up_nr_thres(struct cpu_data *state, char *buf)
 {
 	int i, count = 0;
 	for (i = 0; i < state->num_cpus; i++)
@@ -193,7 +232,7 @@ static ssize_t show_busy_up_thres(struct cpu_data *state, char *buf)
 	return count;
 }
 
-static ssize_t store_busy_down_thres(struct cpu_data *state,
+static ssize_t store_busy_down_nr_thres(struct cpu_data *state,
 					const char *buf, size_t count)
 {
 	unsigned int val[MAX_CPUS_PER_GROUP];
@@ -214,7 +253,7 @@ static ssize_t store_busy_down_thres(struct cpu_data *state,
 	return count;
 }
 
-static ssize_t show_busy_down_thres(struct cpu_data *state, char *buf)
+static ssize_t show_busy_down_nr_thres(struct cpu_data *state, char *buf)
 {
 	int i, count = 0;
 	for (i = 0; i < state->num_cpus; i++)
@@ -234,7 +273,8 @@ static ssize_t show_cpus(struct cpu_data *state, char *buf)
 	list_for_each_entry(c, &state->lru, sib) {
 		count += snprintf(buf + count, PAGE_SIZE - count,
 					"CPU%u (%s)\n", c->cpu,
-					c->online ? "Online" : "Offline");
+					!c->online ? "Offline" :
+					c->isolated ? "Isolated" : "Active");
 	}
 	spin_unlock_irqrestore(&state_lock, flags);
 	return count;
@@ -245,9 +285,9 @@ static ssize_t show_need_cpus(struct cpu_data *state, char *buf)
 	return snprintf(buf, PAGE_SIZE, "%u\n", state->need_cpus);
 }
 
-static ssize_t show_online_cpus(struct cpu_data *state, char *buf)
+static ssize_t show_active_cpus(struct cpu_data *state, char *buf)
 {
-	return snprintf(buf, PAGE_SIZE, "%u\n", state->online_cpus);
+	return snprintf(buf, PAGE_SIZE, "%u\n", state->active_cpus);
 }
 
 static ssize_t show_global_state(struct cpu_data *state, char *buf)
@@ -267,17 +307,17 @@ static ssize_t show_global_state(struct cpu_data *state, char *buf)
 		count += snprintf(buf + count, PAGE_SIZE - count,
 					"\tOnline: %u\n", c->online);
 		count += snprintf(buf + count, PAGE_SIZE - count,
-					"\tRejected: %u\n", c->rejected);
+					"\tIsolated: %u\n", c->isolated);
 		count += snprintf(buf + count, PAGE_SIZE - count,
 					"\tFirst CPU: %u\n", c->first_cpu);
 		count += snprintf(buf + count, PAGE_SIZE - count,
-					"\tBusy%%: %u\n", c->busy);
+					"\tBusy: %u\n", c->busy);
 		count += snprintf(buf + count, PAGE_SIZE - count,
 					"\tIs busy: %u\n", c->is_busy);
 		if (c->cpu != c->first_cpu)
 			continue;
 		count += snprintf(buf + count, PAGE_SIZE - count,
-					"\tAvail CPUs: %u\n", c->avail_cpus);
+					"\tActive CPUs: %u\n", c->active_cpus);
 		count += snprintf(buf + count, PAGE_SIZE - count,
 					"\tNeed CPUs: %u\n", c->need_cpus);
 	}
@@ -303,11 +343,12 @@ core_ctl_attr_rw(min_cpus);
 core_ctl_attr_rw(max_cpus);
 core_ctl_attr_rw(additional_cpus);
 core_ctl_attr_rw(offline_delay_ms);
-core_ctl_attr_rw(busy_up_thres);
-core_ctl_attr_rw(busy_down_thres);
+core_ctl_attr_rw(poll_ms);
+core_ctl_attr_rw(busy_up_nr_thres);
+core_ctl_attr_rw(busy_down_nr_thres);
 core_ctl_attr_ro(cpus);
 core_ctl_attr_ro(need_cpus);
-core_ctl_attr_ro(online_cpus);
+core_ctl_attr_ro(active_cpus);
 core_ctl_attr_ro(global_state);
 
 static struct attribute *default_attrs[] = {
@@ -315,11 +356,12 @@ static struct attribute *default_attrs[] = {
 	&max_cpus.attr,
 	&additional_cpus.attr,
 	&offline_delay_ms.attr,
-	&busy_up_thres.attr,
-	&busy_down_thres.attr,
+	&poll_ms.attr,
+	&busy_up_nr_thres.attr,
+	&busy_down_nr_thres.attr,
 	&cpus.attr,
 	&need_cpus.attr,
-	&online_cpus.attr,
+	&active_cpus.attr,
 	&global_state.attr,
 	NULL
 };
@@ -380,13 +422,19 @@ static int eval_need(struct cpu_data *f)
 		return 0;
 
 	spin_lock_irqsave(&state_lock, flags);
-	thres_idx = f->online_cpus ? f->online_cpus - 1 : 0;
+	thres_idx = f->active_cpus ? f->active_cpus - 1 : 0;
 	list_for_each_entry(c, &f->lru, sib) {
+		bool old_is_busy = c->is_busy;
+
 		if (c->busy >= f->busy_up_thres[thres_idx])
 			c->is_busy = true;
 		else if (c->busy < f->busy_down_thres[thres_idx])
 			c->is_busy = false;
 		need_cpus += c->is_busy;
+
+		if (c->is_busy != old_is_busy)
+			trace_core_ctl_set_busy(c->cpu, c->busy, old_is_busy,
+						c->is_busy);
 	}
 	need_cpus += f->additional_cpus;
 	last_need = f->need_cpus;
@@ -428,36 +476,54 @@ static int eval_need(struct cpu_data *f)
 static void apply_need(struct cpu_data *f)
 {
 	if (eval_need(f))
-		wake_up_hotplug_thread(f);
+		wake_up_core_ctl_thread(f);
 }
 
-static int core_ctl_set_busy(unsigned int cpu, unsigned int busy)
+/*
+ * Project the decayed nr_running average of @c one poll period ahead: a
+ * rising average is extrapolated linearly so that a cluster ramping up gets
+ * its CPUs back before the average itself crosses the threshold. A falling
+ * average is taken as is; offline_delay_ms already damps parking.
+ */
+static unsigned int predict_busy(struct cpu_data *c)
 {
-	struct cpu_data *c = &per_cpu(cpu_state, cpu);
-	struct cpu_data *f;
-	unsigned int old_is_busy = c->is_busy;
+	unsigned int nr = core_ctl_nr_running_avg(c->cpu);
+	unsigned int pred = nr;
 
-	if (!c->inited)
-		return 0;
+	if (nr > c->nr_avg)
+		pred += nr - c->nr_avg;
+	c->nr_avg = nr;
 
-	if (c->busy == busy)
-		return 0;
+	return (pred * 100) >> FSHIFT;
+}
+
+static void core_ctl_poll_func(unsigned long cpu)
+{
+	struct cpu_data *f = &per_cpu(cpu_state, cpu);
+	struct cpu_data *c;
+	unsigned long flags;
+
+	if (unlikely(!f->inited))
+		return;
+
+	spin_lock_irqsave(&state_lock, flags);
+	list_for_each_entry(c, &f->lru, sib)
+		c->busy = c->online ? predict_busy(c) : 0;
+	spin_unlock_irqrestore(&state_lock, flags);
 
-	c->busy = busy;
-	f = &per_cpu(cpu_state, c->first_cpu);
 	apply_need(f);
-	trace_core_ctl_set_busy(cpu, busy, old_is_busy, c->is_busy);
-	return 0;
+
+	mod_timer(&f->poll_timer, jiffies + msecs_to_jiffies(f->poll_ms));
 }
 
 /* ========================= core count enforcement ==================== */
 
 /*
- * If current thread is hotplug thread, don't attempt to wake up
- * itself or other hotplug threads because it will deadlock. Instead,
+ * If current thread is a core_ctl thread, don't attempt to wake up
+ * itself or other core_ctl threads because it will deadlock. Instead,
  * schedule a timer to fire in next timer tick and wake up the thread.
  */
-static void wake_up_hotplug_thread(struct cpu_data *state)
+static void wake_up_core_ctl_thread(struct cpu_data *state)
 {
 	unsigned long flags;
 	int cpu;
@@ -468,7 +534,7 @@ static void wake_up_hotplug_thread(struct cpu_data *state)
 		pcpu = &per_cpu(cpu_state, cpu);
 		if (cpu != pcpu->first_cpu)
 			continue;
-		if (pcpu->hotplug_thread == current) {
+		if (pcpu->core_ctl_thread == current) {
 			no_wakeup = true;
 			break;
 		}
@@ -483,7 +549,7 @@ static void wake_up_hotplug_thread(struct cpu_data *state)
 		mod_timer(&state->timer, jiffies);
 		spin_unlock_irqrestore(&state_lock, flags);
 	} else {
-		wake_up_process(state->hotplug_thread);
+		wake_up_process(state->core_ctl_thread);
 	}
 }
 
@@ -496,12 +562,49 @@ static void core_ctl_timer_func(unsigned long cpu)
 		spin_lock_irqsave(&state->pending_lock, flags);
 		state->pending = true;
 		spin_unlock_irqrestore(&state->pending_lock, flags);
-		wake_up_process(state->hotplug_thread);
+		wake_up_process(state->core_ctl_thread);
 	}
 
 }
 
-static void __ref do_hotplug(struct cpu_data *f)
+static void isolate_cpu(struct cpu_data *f, struct cpu_data *c)
+{
+	unsigned long flags;
+
+	if (!c->cpu)
+		return;
+
+	pr_debug("Trying to isolate CPU%u\n", c->cpu);
+	if (core_ctl_isolate_core(c->cpu)) {
+		pr_debug("Unable to isolate CPU%u\n", c->cpu);
+		return;
+	}
+
+	spin_lock_irqsave(&state_lock, flags);
+	c->isolated = true;
+	f->active_cpus--;
+	list_move_tail(&c->sib, &f->lru);
+	spin_unlock_irqrestore(&state_lock, flags);
+}
+
+static void unisolate_cpu(struct cpu_data *f, struct cpu_data *c)
+{
+	unsigned long flags;
+
+	pr_debug("Trying to unisolate CPU%u\n", c->cpu);
+	if (core_ctl_unisolate_core(c->cpu)) {
+		pr_debug("Unable to unisolate CPU%u\n", c->cpu);
+		return;
+	}
+
+	spin_lock_irqsave(&state_lock, flags);
+	c->isolated = false;
+	f->active_cpus++;
+	list_move_tail(&c->sib, &f->lru);
+	spin_unlock_irqrestore(&state_lock, flags);
+}
+
+static void do_core_ctl(struct cpu_data *f)
 {
 	unsigned int need;
 	struct cpu_data *c, *tmp;
@@ -509,65 +612,51 @@ static void __ref do_hotplug(struct cpu_data *f)
 	need = needed_cpus(f);
 	pr_debug("Trying to adjust group %u to %u\n", f->first_cpu, need);
 
-	if (f->online_cpus > need) {
+	if (f->active_cpus > need) {
 		list_for_each_entry_safe(c, tmp, &f->lru, sib) {
-			if (!c->online)
+			if (!c->online || c->isolated)
 				continue;
 
-			if (f->online_cpus == need)
+			if (f->active_cpus == need)
 				break;
 
-			/* Don't offline busy CPUs. */
+			/* Don't isolate busy CPUs. */
 			if (c->is_busy)
 				continue;
 
-			pr_debug("Trying to Offline CPU%u\n", c->cpu);
-
-			if (!c->cpu)
-				continue;
-
-			if (cpu_down(c->cpu))
-				pr_debug("Unable to Offline CPU%u\n", c->cpu);
+			isolate_cpu(f, c);
 		}
 
 		/*
-		 * If the number of online CPUs is within the limits, then
-		 * don't force any busy CPUs offline.
+		 * If the number of active CPUs is within the limits, then
+		 * don't force any busy CPUs into isolation.
 		 */
-		if (f->online_cpus <= f->max_cpus)
+		if (f->active_cpus <= f->max_cpus)
 			return;
 
 		list_for_each_entry_safe(c, tmp, &f->lru, sib) {
-			if (!c->online)
+			if (!c->online || c->isolated)
 				continue;
 
-			if (f->online_cpus <= f->max_cpus)
+			if (f->active_cpus <= f->max_cpus)
 				break;
 
-			pr_debug("Trying to Offline CPU%u\n", c->cpu);
-
-			if (!c->cpu)
-				continue;
-
-			if (cpu_down(c->cpu))
-				pr_debug("Unable to Offline CPU%u\n", c->cpu);
+			isolate_cpu(f, c);
 		}
-	} else if (f->online_cpus < need) {
+	} else if (f->active_cpus < need) {
 		list_for_each_entry_safe(c, tmp, &f->lru, sib) {
-			if (c->online || c->rejected)
+			if (!c->online || !c->isolated)
 				continue;
 
-			if (f->online_cpus == need)
+			if (f->active_cpus == need)
 				break;
 
-			pr_debug("Trying to Online CPU%u\n", c->cpu);
-			if (core_ctl_online_core(c->cpu))
-				pr_debug("Unable to Online CPU%u\n", c->cpu);
+			unisolate_cpu(f, c);
 		}
 	}
 }
 
-static int __ref try_hotplug(void *data)
+static int try_core_ctl(void *data)
 {
 	struct cpu_data *f = data;
 	unsigned long flags;
@@ -586,7 +675,10 @@ static int __ref try_hotplug(void *data)
 		f->pending = false;
 		spin_unlock_irqrestore(&f->pending_lock, flags);
 
-		do_hotplug(f);
+		/* Keep the online state stable while CPUs are (un)isolated */
+		core_ctl_block_hotplug();
+		do_core_ctl(f);
+		core_ctl_unblock_hotplug();
 	}
 
 	return 0;
@@ -598,7 +690,6 @@ static int __ref cpu_callback(struct notifier_block *nfb,
 	uint32_t cpu = (uintptr_t)hcpu;
 	struct cpu_data *state = &per_cpu(cpu_state, cpu);
 	struct cpu_data *f;
-	int ret = NOTIFY_OK;
 	unsigned long flags;
 
 	/* Don't affect suspend resume */
@@ -611,81 +702,45 @@ static int __ref cpu_callback(struct notifier_block *nfb,
 	f = &per_cpu(cpu_state, state->first_cpu);
 
 	switch (action) {
-	case CPU_UP_PREPARE:
-
+	case CPU_ONLINE:
+		spin_lock_irqsave(&state_lock, flags);
 		/* If online state of CPU somehow got out of sync, fix it. */
 		if (state->online) {
-			f->online_cpus--;
-			state->online = false;
-			pr_warn("CPU%d offline when state is online\n", cpu);
-		}
-
-		if (state->rejected) {
-			state->rejected = false;
-			f->avail_cpus++;
-		}
-
-		/*
-		 * If a CPU is in the process of coming up, mark it as online
-		 * so that there's no race with hotplug thread bringing up more
-		 * CPUs than necessary.
-		 */
-		if (needed_cpus(f) <= f->online_cpus) {
-			pr_debug("Prevent CPU%d onlining\n", cpu);
-			ret = NOTIFY_BAD;
+			pr_warn("CPU%d onlined when state is online\n", cpu);
 		} else {
 			state->online = true;
-			f->online_cpus++;
+			f->active_cpus++;
 		}
-		break;
-
-	case CPU_ONLINE:
-		/*
-		 * Moving to the end of the list should only happen in
-		 * CPU_ONLINE and not on CPU_UP_PREPARE to prevent an
-		 * infinite list traversal when thermal (or other entities)
-		 * reject trying to online CPUs.
-		 */
-		spin_lock_irqsave(&state_lock, flags);
-		list_del(&state->sib);
-		list_add_tail(&state->sib, &f->lru);
+		state->isolated = false;
+		list_move_tail(&state->sib, &f->lru);
 		spin_unlock_irqrestore(&state_lock, flags);
 		break;
 
 	case CPU_DEAD:
-		/* Move a CPU to the end of the LRU when it goes offline. */
+		/*
+		 * The scheduler drops the isolation of a CPU going offline by
+		 * itself; only the bookkeeping needs to follow.
+		 */
 		spin_lock_irqsave(&state_lock, flags);
-		list_del(&state->sib);
-		list_add_tail(&state->sib, &f->lru);
-		spin_unlock_irqrestore(&state_lock, flags);
-
-		/* Fall through */
-
-	case CPU_UP_CANCELED:
-
-		/* If online state of CPU somehow got out of sync, fix it. */
-		if (!state->online) {
-			f->online_cpus++;
-			pr_warn("CPU%d online when state is offline\n", cpu);
-		}
-
-		if (!state->rejected && action == CPU_UP_CANCELED) {
-			state->rejected = true;
-			f->avail_cpus--;
-		}
-
+		if (!state->online)
+			pr_warn("CPU%d died when state is offline\n", cpu);
+		else if (!state->isolated)
+			f->active_cpus--;
 		state->online = false;
+		state->isolated = false;
 		state->busy = 0;
-		f->online_cpus--;
+		list_move_tail(&state->sib, &f->lru);
+		spin_unlock_irqrestore(&state_lock, flags);
 		break;
+
+	default:
+		return NOTIFY_OK;
 	}
 
-	if (f->online_cpus < needed_cpus(f)
-	    && f->online_cpus < f->avail_cpus
-	    && action == CPU_DEAD)
-		wake_up_hotplug_thread(f);
+	if (f->active_cpus != needed_cpus(f))
+		wake_up_core_ctl_thread(f);
 
-	return ret;
+	return NOTIFY_OK;
 }
 
 static struct notifier_block __refdata cpu_notifier = {
@@ -719,14 +774,21 @@ static int group_init(struct cpumask *mask)
 	f->min_cpus = 1;
 	f->max_cpus = f->num_cpus;
 	f->need_cpus  = f->num_cpus;
-	f->avail_cpus  = f->num_cpus;
 	f->additional_cpus = 1;
 	f->offline_delay_ms = 100;
+	f->poll_ms = 20;
+	for (cpu = 0; cpu < MAX_CPUS_PER_GROUP; cpu++) {
+		f->busy_up_thres[cpu] = 60;
+		f->busy_down_thres[cpu] = 30;
+	}
 	INIT_LIST_HEAD(&f->lru);
 	init_timer(&f->timer);
 	spin_lock_init(&f->pending_lock);
 	f->timer.function = core_ctl_timer_func;
 	f->timer.data = first_cpu;
+	init_timer_deferrable(&f->poll_timer);
+	f->poll_timer.function = core_ctl_poll_func;
+	f->poll_timer.data = first_cpu;
 
 	for_each_cpu(cpu, mask) {
 		pr_info("Init CPU%u state\n", cpu);
@@ -736,19 +798,20 @@ static int group_init(struct cpumask *mask)
 		state->first_cpu = first_cpu;
 
 		if (cpu_online(cpu)) {
-			f->online_cpus++;
+			f->active_cpus++;
 			state->online = true;
 		}
 
 		list_add_tail(&state->sib, &f->lru);
 	}
 
-	f->hotplug_thread = kthread_run(try_hotplug, (void *) f,
-					"core_ctl/%d", first_cpu);
+	f->core_ctl_thread = kthread_run(try_core_ctl, (void *) f,
+					 "core_ctl/%d", first_cpu);
 	for_each_cpu(cpu, mask) {
 		state = &per_cpu(cpu_state, cpu);
 		state->inited = true;
 	}
+	mod_timer(&f->poll_timer, jiffies + msecs_to_jiffies(f->poll_ms));
 
 	kobject_init(&f->kobj, &ktype_core_ctl);
 	return kobject_add(&f->kobj, &dev->kobj, "core_ctl");
@@ -772,24 +835,6 @@ static struct notifier_block cpufreq_pol_nb = {
 	.notifier_call = cpufreq_policy_cb,
 };
 
-static int cpufreq_gov_cb(struct notifier_block *nb, unsigned long val,
-				void *data)
-{
-	struct cpufreq_govinfo *info = data;
-
-	switch (val) {
-	case CPUFREQ_LOAD_CHANGE:
-		core_ctl_set_busy(info->cpu, info->load);
-		break;
-	}
-
-	return NOTIFY_OK;
-}
-
-static struct notifier_block cpufreq_gov_nb = {
-	.notifier_call = cpufreq_gov_cb,
-};
-
 static int __init core_ctl_init(void)
 {
 	struct cpufreq_policy *policy;
@@ -797,7 +842,6 @@ static int __init core_ctl_init(void)
 
 	register_cpu_notifier(&cpu_notifier);
 	cpufreq_register_notifier(&cpufreq_pol_nb, CPUFREQ_POLICY_NOTIFIER);
-	cpufreq_register_notifier(&cpufreq_gov_nb, CPUFREQ_GOVINFO_NOTIFIER);
 
 	core_ctl_block_hotplug();
 	for_each_online_cpu(cpu) {
@@ -818,18 +862,27 @@ static void __exit core_ctl_exit(void)
 
 	unregister_cpu_notifier(&cpu_notifier);
 	cpufreq_unregister_notifier(&cpufreq_pol_nb, CPUFREQ_POLICY_NOTIFIER);
-	cpufreq_unregister_notifier(&cpufreq_gov_nb, CPUFREQ_GOVINFO_NOTIFIER);
 
 	for_each_possible_cpu(cpu) {
 		pcpu = &per_cpu(cpu_state, cpu);
 		if (pcpu->inited && cpu == pcpu->first_cpu) {
 			pcpu->inited = false;
+			del_timer_sync(&pcpu->poll_timer);
 			del_timer_sync(&pcpu->timer);
-			kthread_stop(pcpu->hotplug_thread);
+			kthread_stop(pcpu->core_ctl_thread);
 			kobject_put(&pcpu->kobj);
 		}
 		pcpu->inited = false;
 	}
+
+	/* Hand every parked CPU back to the scheduler */
+	for_each_possible_cpu(cpu) {
+		pcpu = &per_cpu(cpu_state, cpu);
+		if (pcpu->isolated) {
+			core_ctl_unisolate_core(cpu);
+			pcpu->isolated = false;
+		}
+	}
 }
 
 module_init(core_ctl_init);
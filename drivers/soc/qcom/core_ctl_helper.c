@@ -17,6 +17,7 @@
 #include <linux/hrtimer.h>
 #include <linux/module.h>
 #include <linux/init.h>
+#include <linux/sched.h>
 #include <soc/qcom/core_ctl.h>
 
 void core_ctl_block_hotplug(void)
@@ -55,8 +56,20 @@ struct device *core_ctl_find_cpu_device(unsigned cpu)
 }
 EXPORT_SYMBOL(core_ctl_find_cpu_device);
 
-int __ref core_ctl_online_core(unsigned int cpu)
+int core_ctl_isolate_core(unsigned int cpu)
 {
-	return cpu_up(cpu);
+	return sched_isolate_cpu(cpu);
 }
-EXPORT_SYMBOL(core_ctl_online_core);
+EXPORT_SYMBOL(core_ctl_isolate_core);
+
+int core_ctl_unisolate_core(unsigned int cpu)
+{
+	return sched_unisolate_cpu(cpu);
+}
+EXPORT_SYMBOL(core_ctl_unisolate_core);
+
+unsigned int core_ctl_nr_running_avg(unsigned int cpu)
+{
+	return avg_cpu_nr_running(cpu);
+}
+EXPORT_SYMBOL(core_ctl_nr_running_avg);
@@ -14,17 +14,48 @@
  *
  */
 
+#include <linux/cpu.h>
 #include <linux/debugfs.h>
 #include <linux/dma-mapping.h>
 #include <linux/err.h>
 #include <linux/fs.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/percpu.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
 #include <linux/vmalloc.h>
+#include <linux/vmstat.h>
 #include "ion_priv.h"
 
+/*
+ * Each cpu keeps up to ION_PAGE_POOL_CPU_PAGES base pages worth of items in
+ * front of the pool mutex, so orders whose items are larger than that get
+ * no front cache. The caches are only touched with interrupts disabled on
+ * their own cpu; shrinking drains them by IPI.
+ */
+#define ION_PAGE_POOL_CPU_PAGES	32
+
+struct ion_page_pool_cpu_cache {
+	int count;
+	/* items of @pages that are not highmem */
+	int low;
+	struct page *pages[ION_PAGE_POOL_CPU_PAGES];
+};
+
+/*
+ * High order pools are topped up in the background to prefill_kb worth of
+ * items, rounded down to whole items so that prefill never pins more than
+ * prefill_kb per pool: with the default, order 9 pools are not prefilled.
+ * Prefill only runs while free memory is above the reserves by a margin and
+ * not for ION_PAGE_POOL_PREFILL_BACKOFF after the pool was shrunk. A zero
+ * prefill_kb turns it off.
+ */
+#define ION_PAGE_POOL_PREFILL_BACKOFF	(5 * HZ)
+
+static unsigned int ion_page_pool_prefill_kb = 1024;
+module_param_named(prefill_kb, ion_page_pool_prefill_kb, uint, 0644);
+
 static void *ion_page_pool_alloc_pages(struct ion_page_pool *pool)
 {
 	struct page *page;
@@ -64,6 +95,185 @@ static int ion_page_pool_add(struct ion_page_pool *pool, struct page *page)
 	return 0;
 }
 
+static int ion_page_pool_cpu_cache_size(unsigned int order)
+{
+	return ION_PAGE_POOL_CPU_PAGES >> order;
+}
+
+static struct page *ion_page_pool_cpu_get(struct ion_page_pool *pool)
+{
+	struct ion_page_pool_cpu_cache *cache;
+	struct page *page = NULL;
+	unsigned long flags;
+
+	if (!pool->cpu_caches)
+		return NULL;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(pool->cpu_caches);
+	if (cache->count) {
+		page = cache->pages[--cache->count];
+		if (!PageHighMem(page))
+			cache->low--;
+	}
+	local_irq_restore(flags);
+
+	return page;
+}
+
+static bool ion_page_pool_cpu_put(struct ion_page_pool *pool,
+				  struct page *page)
+{
+	struct ion_page_pool_cpu_cache *cache;
+	unsigned long flags;
+	bool cached = false;
+
+	if (!pool->cpu_caches)
+		return false;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(pool->cpu_caches);
+	if (cache->count < ion_page_pool_cpu_cache_size(pool->order)) {
+		cache->pages[cache->count++] = page;
+		if (!PageHighMem(page))
+			cache->low++;
+		cached = true;
+	}
+	local_irq_restore(flags);
+
+	return cached;
+}
+
+struct ion_page_pool_cpu_drain_args {
+	struct ion_page_pool *pool;
+	bool high;
+};
+
+/* frees the lowmem items of a front cache, and the highmem ones if @high */
+static void ion_page_pool_cpu_drain(struct ion_page_pool *pool,
+				    struct ion_page_pool_cpu_cache *cache,
+				    bool high)
+{
+	int i, kept = 0;
+
+	for (i = 0; i < cache->count; i++) {
+		struct page *page = cache->pages[i];
+
+		if (!high && PageHighMem(page))
+			cache->pages[kept++] = page;
+		else
+			ion_page_pool_free_pages(pool, page);
+	}
+	cache->count = kept;
+	cache->low = 0;
+}
+
+static void ion_page_pool_cpu_drain_local(void *data)
+{
+	struct ion_page_pool_cpu_drain_args *args = data;
+
+	ion_page_pool_cpu_drain(args->pool,
+				this_cpu_ptr(args->pool->cpu_caches),
+				args->high);
+}
+
+static int __ion_page_pool_cpu_count(struct ion_page_pool *pool, bool high)
+{
+	struct ion_page_pool_cpu_cache *cache;
+	int cpu, count = 0;
+
+	if (!pool->cpu_caches)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(pool->cpu_caches, cpu);
+		count += high ? ACCESS_ONCE(cache->count) :
+				ACCESS_ONCE(cache->low);
+	}
+
+	return count;
+}
+
+int ion_page_pool_cpu_count(struct ion_page_pool *pool)
+{
+	return __ion_page_pool_cpu_count(pool, true);
+}
+
+/*
+ * Frees the items a shrink request of this kind may take from the front
+ * caches, online cpus or not. Lowmem-only requests leave highmem items be.
+ */
+static void ion_page_pool_cpu_drain_all(struct ion_page_pool *pool, bool high)
+{
+	struct ion_page_pool_cpu_drain_args args = {
+		.pool = pool,
+		.high = high,
+	};
+	int cpu;
+
+	if (!__ion_page_pool_cpu_count(pool, high))
+		return;
+
+	get_online_cpus();
+	on_each_cpu(ion_page_pool_cpu_drain_local, &args, 1);
+	for_each_possible_cpu(cpu)
+		if (!cpu_online(cpu))
+			ion_page_pool_cpu_drain(pool,
+					per_cpu_ptr(pool->cpu_caches, cpu),
+					high);
+	put_online_cpus();
+}
+
+static int ion_page_pool_prefill_target(struct ion_page_pool *pool)
+{
+	if (!pool->order)
+		return 0;
+
+	return ((unsigned long)ACCESS_ONCE(ion_page_pool_prefill_kb) << 10) /
+		(PAGE_SIZE << pool->order);
+}
+
+static bool ion_page_pool_can_prefill(struct ion_page_pool *pool)
+{
+	unsigned long free = global_page_state(NR_FREE_PAGES);
+
+	if (time_before(jiffies, pool->last_shrink +
+			ION_PAGE_POOL_PREFILL_BACKOFF))
+		return false;
+
+	return free > totalreserve_pages + (totalram_pages >> 5) +
+		(1 << pool->order);
+}
+
+static void ion_page_pool_prefill(struct work_struct *work)
+{
+	struct ion_page_pool *pool = container_of(work, struct ion_page_pool,
+						  prefill_work);
+	int target = ion_page_pool_prefill_target(pool);
+	struct page *page;
+
+	while (pool->high_count + pool->low_count < target &&
+	       ion_page_pool_can_prefill(pool)) {
+		/* pool items must be zeroed and clean, as on the free path */
+		page = alloc_pages(pool->gfp_mask & ~__GFP_ZERO, pool->order);
+		if (!page)
+			break;
+		if (msm_ion_heap_high_order_page_zero(page, pool->order)) {
+			ion_page_pool_free_pages(pool, page);
+			break;
+		}
+		ion_page_pool_add(pool, page);
+		cond_resched();
+	}
+}
+
+static void ion_page_pool_kick_prefill(struct ion_page_pool *pool)
+{
+	if (pool->high_count + pool->low_count <
+	    ion_page_pool_prefill_target(pool))
+		queue_work(system_unbound_wq, &pool->prefill_work);
+}
+
 static struct page *ion_page_pool_remove(struct ion_page_pool *pool, bool high)
 {
 	struct page *page;
@@ -90,6 +300,10 @@ void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
 
 	*from_pool = true;
 
+	page = ion_page_pool_cpu_get(pool);
+	if (page)
+		return page;
+
 	if (mutex_trylock(&pool->mutex)) {
 		if (pool->high_count)
 			page = ion_page_pool_remove(pool, true);
@@ -97,6 +311,7 @@ void *ion_page_pool_alloc(struct ion_page_pool *pool, bool *from_pool)
 			page = ion_page_pool_remove(pool, false);
 		mutex_unlock(&pool->mutex);
 	}
+	ion_page_pool_kick_prefill(pool);
 	if (!page) {
 		page = ion_page_pool_alloc_pages(pool);
 		*from_pool = false;
@@ -108,6 +323,9 @@ void ion_page_pool_free(struct ion_page_pool *pool, struct page *page)
 {
 	int ret;
 
+	if (ion_page_pool_cpu_put(pool, page))
+		return;
+
 	ret = ion_page_pool_add(pool, page);
 	if (ret)
 		ion_page_pool_free_pages(pool, page);
@@ -120,6 +338,7 @@ static int ion_page_pool_total(struct ion_page_pool *pool, bool high)
 	total += high ? (pool->high_count + pool->low_count) *
 		(1 << pool->order) :
 			pool->low_count * (1 << pool->order);
+	total += __ion_page_pool_cpu_count(pool, high) * (1 << pool->order);
 	return total;
 }
 
@@ -134,6 +353,9 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 	else
 		high = !!(gfp_mask & __GFP_HIGHMEM);
 
+	if (nr_to_scan)
+		pool->last_shrink = jiffies;
+
 	for (i = 0; i < nr_to_scan; i++) {
 		struct page *page;
 
@@ -150,6 +372,10 @@ int ion_page_pool_shrink(struct ion_page_pool *pool, gfp_t gfp_mask,
 		ion_page_pool_free_pages(pool, page);
 	}
 
+	/* only strip the front caches once the pool itself ran dry */
+	if (i < nr_to_scan)
+		ion_page_pool_cpu_drain_all(pool, high);
+
 	return ion_page_pool_total(pool, high);
 }
 
@@ -167,12 +393,34 @@ struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order)
 	pool->order = order;
 	mutex_init(&pool->mutex);
 	plist_node_init(&pool->list, order);
+	INIT_WORK(&pool->prefill_work, ion_page_pool_prefill);
+	pool->last_shrink = jiffies - ION_PAGE_POOL_PREFILL_BACKOFF;
+
+	pool->cpu_caches = NULL;
+	if (ion_page_pool_cpu_cache_size(order)) {
+		pool->cpu_caches =
+			alloc_percpu(struct ion_page_pool_cpu_cache);
+		if (!pool->cpu_caches) {
+			kfree(pool);
+			return NULL;
+		}
+	}
 
 	return pool;
 }
 
 void ion_page_pool_destroy(struct ion_page_pool *pool)
 {
+	int cpu;
+
+	cancel_work_sync(&pool->prefill_work);
+	if (pool->cpu_caches) {
+		for_each_possible_cpu(cpu)
+			ion_page_pool_cpu_drain(pool,
+					per_cpu_ptr(pool->cpu_caches, cpu),
+					true);
+		free_percpu(pool->cpu_caches);
+	}
 	kfree(pool);
 }
 
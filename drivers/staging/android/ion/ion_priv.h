@@ -30,6 +30,7 @@
 #include <linux/sched.h>
 #include <linux/shrinker.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 #include "ion.h"
 
@@ -387,6 +388,10 @@ void ion_carveout_free(struct ion_heap *heap, ion_phys_addr_t addr,
  * @gfp_mask:		gfp_mask to use from alloc
  * @order:		order of pages in the pool
  * @list:		plist node for list of pools
+ * @cpu_caches:		per-cpu front caches taken before @mutex, NULL for
+ *			orders too large to cache per cpu
+ * @prefill_work:	tops high order pools up to the prefill watermark
+ * @last_shrink:	jiffies of the last shrink, prefill backs off after it
  *
  * Allows you to keep a pool of pre allocated pages to use from your heap.
  * Keeping a pool of pages that is ready for dma, ie any cached mapping have
@@ -402,6 +407,9 @@ struct ion_page_pool {
 	gfp_t gfp_mask;
 	unsigned int order;
 	struct plist_node list;
+	struct ion_page_pool_cpu_cache __percpu *cpu_caches;
+	struct work_struct prefill_work;
+	unsigned long last_shrink;
 };
 
 struct ion_page_pool *ion_page_pool_create(gfp_t gfp_mask, unsigned int order);
@@ -409,6 +417,11 @@ void ion_page_pool_destroy(struct ion_page_pool *);
 void *ion_page_pool_alloc(struct ion_page_pool *, bool *from_pool);
 void ion_page_pool_free(struct ion_page_pool *, struct page *);
 
+/** ion_page_pool_cpu_count - number of items held in per-cpu front caches
+ * @pool:		the pool
+ */
+int ion_page_pool_cpu_count(struct ion_page_pool *pool);
+
 /** ion_page_pool_shrink - shrinks the size of the memory cached in the pool
  * @pool:		the pool
  * @gfp_mask:		the memory type to reclaim
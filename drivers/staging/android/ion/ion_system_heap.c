@@ -399,6 +399,7 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 
 	for (i = 0; i < num_orders; i++) {
 		struct ion_page_pool *pool = sys_heap->uncached_pools[i];
+		int cpu_count = ion_page_pool_cpu_count(pool);
 
 		if (use_seq) {
 			seq_printf(s,
@@ -411,17 +412,25 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 				pool->low_count, pool->order,
 				(1 << pool->order) * PAGE_SIZE *
 					pool->low_count);
+			seq_printf(s,
+				"%d order %u pages in uncached per-cpu caches = %lu total\n",
+				cpu_count, pool->order,
+				(1 << pool->order) * PAGE_SIZE * cpu_count);
 		} else {
 			uncached_total += (1 << pool->order) * PAGE_SIZE *
 						pool->high_count;
 			uncached_total += (1 << pool->order) * PAGE_SIZE *
 						pool->low_count;
+			uncached_total += (1 << pool->order) * PAGE_SIZE *
+						cpu_count;
 		}
 
 	}
 
 	for (i = 0; i < num_orders; i++) {
 		struct ion_page_pool *pool = sys_heap->cached_pools[i];
+		int cpu_count = ion_page_pool_cpu_count(pool);
+
 		if (use_seq) {
 			seq_printf(s,
 				"%d order %u highmem pages in cached pool = %lu total\n",
@@ -432,11 +441,17 @@ static int ion_system_heap_debug_show(struct ion_heap *heap, struct seq_file *s,
 				pool->low_count, pool->order,
 				(1 << pool->order) * PAGE_SIZE *
 					pool->low_count);
+			seq_printf(s,
+				"%d order %u pages in cached per-cpu caches = %lu total\n",
+				cpu_count, pool->order,
+				(1 << pool->order) * PAGE_SIZE * cpu_count);
 		} else {
 			cached_total += (1 << pool->order) * PAGE_SIZE *
 						pool->high_count;
 			cached_total += (1 << pool->order) * PAGE_SIZE *
 						pool->low_count;
+			cached_total += (1 << pool->order) * PAGE_SIZE *
+						cpu_count;
 		}
 	}
 
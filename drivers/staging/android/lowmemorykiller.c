@@ -15,6 +15,11 @@
  *
  * The driver considers memory used for caches to be free.
  *
+ * Candidate processes are kept in an index bucketed by oom_score_adj which
+ * is maintained on fork, exec, exit and whenever oom_score_adj is written,
+ * so victim selection looks at the highest populated bucket only instead of
+ * walking every process in the system.
+ *
  * Copyright (C) 2007-2008 Google, Inc.
  *
  * This software is licensed under the terms of the GNU General Public
@@ -49,6 +54,7 @@
 #include <linux/cpuset.h>
 #include <linux/show_mem_notifier.h>
 #include <linux/vmpressure.h>
+#include <linux/psi.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/almk.h>
@@ -83,6 +89,19 @@ static int lowmem_minfree_size = 4;
 static int lmk_fast_run = 1;
 
 static unsigned long lowmem_deathpending_timeout;
+static struct task_struct *lowmem_deathpending;
+
+#define LOWMEM_ADJ_BUCKETS	(OOM_SCORE_ADJ_MAX - OOM_SCORE_ADJ_MIN + 1)
+
+/*
+ * Thread group leaders indexed by oom_score_adj, one bucket per adj value.
+ * A set bit in lowmem_index_map marks a non-empty bucket.  lmk_rss caches
+ * the RSS of the process as of the last adj update, it is only used to
+ * order candidates that share a bucket.
+ */
+static struct hlist_head lowmem_index[LOWMEM_ADJ_BUCKETS];
+static DECLARE_BITMAP(lowmem_index_map, LOWMEM_ADJ_BUCKETS);
+static DEFINE_SPINLOCK(lowmem_index_lock);
 
 #define lowmem_print(level, x...)			\
 	do {						\
@@ -189,6 +208,48 @@ static struct notifier_block lmk_vmpr_nb = {
 	.notifier_call = lmk_vmpressure_notifier,
 };
 
+#ifdef CONFIG_PSI
+/*
+ * User knob to select victims from memory stall averages instead of the
+ * minfree table.  A 10s "some" average at or above psi_some_threshold
+ * percent kills from the highest adj level only, a "full" average at or
+ * above psi_full_threshold kills down to the lowest configured adj level.
+ * The averages decay slowly after a kill, so further stall driven kills
+ * are held off for psi_holdoff_ms.
+ */
+static int enable_psi_lmk;
+module_param_named(enable_psi_lmk, enable_psi_lmk, int, S_IRUGO | S_IWUSR);
+static int psi_some_threshold = 10;
+module_param_named(psi_some_threshold, psi_some_threshold, int,
+	S_IRUGO | S_IWUSR);
+static int psi_full_threshold = 30;
+module_param_named(psi_full_threshold, psi_full_threshold, int,
+	S_IRUGO | S_IWUSR);
+static int psi_holdoff_ms = 3000;
+module_param_named(psi_holdoff_ms, psi_holdoff_ms, int, S_IRUGO | S_IWUSR);
+
+static unsigned long lowmem_psi_holdoff;
+
+static short lowmem_psi_min_adj(int array_size)
+{
+	unsigned int some = psi_mem_pressure(PSI_MEM_SOME, PSI_AVG10);
+	unsigned int full = psi_mem_pressure(PSI_MEM_FULL, PSI_AVG10);
+	short min_score_adj = OOM_SCORE_ADJ_MAX + 1;
+
+	if (array_size <= 0 || time_before_eq(jiffies, lowmem_psi_holdoff))
+		return min_score_adj;
+
+	if (full >= psi_full_threshold)
+		min_score_adj = lowmem_adj[0];
+	else if (some >= psi_some_threshold)
+		min_score_adj = lowmem_adj[array_size - 1];
+
+	lowmem_print(4, "lowmem_shrink psi some %u%% full %u%%, ma %hd\n",
+		     some, full, min_score_adj);
+	return min_score_adj;
+}
+#endif
+
 static int test_task_flag(struct task_struct *p, int flag)
 {
 	struct task_struct *t;
@@ -205,7 +266,171 @@ static int test_task_flag(struct task_struct *p, int flag)
 	return 0;
 }
 
-static DEFINE_MUTEX(scan_mutex);
+static void __lowmem_index_insert(struct task_struct *p, short adj)
+{
+	int bucket = adj - OOM_SCORE_ADJ_MIN;
+
+	p->lmk_adj = adj;
+	hlist_add_head(&p->lmk_node, &lowmem_index[bucket]);
+	__set_bit(bucket, lowmem_index_map);
+}
+
+static void __lowmem_index_remove(struct task_struct *p)
+{
+	int bucket = p->lmk_adj - OOM_SCORE_ADJ_MIN;
+
+	hlist_del_init(&p->lmk_node);
+	if (hlist_empty(&lowmem_index[bucket]))
+		__clear_bit(bucket, lowmem_index_map);
+}
+
+/*
+ * Called with tasklist_lock held for writing when a new thread group leader
+ * is linked into the task list, and from exec once PF_KTHREAD is dropped.
+ */
+void lowmem_index_add(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (p->flags & PF_KTHREAD)
+		return;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	if (hlist_unhashed(&p->lmk_node)) {
+		p->lmk_rss = p->mm ? get_mm_rss(p->mm) : 0;
+		__lowmem_index_insert(p, p->signal->oom_score_adj);
+	}
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+/* Called with tasklist_lock held for writing once the group is dead. */
+void lowmem_index_del(struct task_struct *p)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	if (!hlist_unhashed(&p->lmk_node))
+		__lowmem_index_remove(p);
+	if (lowmem_deathpending == p)
+		lowmem_deathpending = NULL;
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+/* Called from de_thread() when a non-leader thread takes over the group. */
+void lowmem_index_replace(struct task_struct *old, struct task_struct *new)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	if (!hlist_unhashed(&old->lmk_node)) {
+		new->lmk_rss = old->lmk_rss;
+		__lowmem_index_remove(old);
+		__lowmem_index_insert(new, old->lmk_adj);
+	}
+	if (lowmem_deathpending == old)
+		lowmem_deathpending = new;
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+/*
+ * Called after task->signal->oom_score_adj has been changed, with
+ * task_lock(task) held and task->mm valid.
+ */
+void lowmem_index_update(struct task_struct *task)
+{
+	struct task_struct *leader = task->group_leader;
+	short adj = task->signal->oom_score_adj;
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	if (hlist_unhashed(&leader->lmk_node)) {
+		/* Never resurrect a group that has already been unhashed */
+		if ((leader->flags & PF_KTHREAD) ||
+		    !thread_group_leader(leader) || !pid_alive(leader))
+			goto out;
+	} else {
+		__lowmem_index_remove(leader);
+	}
+	leader->lmk_rss = get_mm_rss(task->mm);
+	__lowmem_index_insert(leader, adj);
+out:
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
+
+/* candidates passed over for the rest of one lowmem_shrink() call */
+#define LOWMEM_PICK_SKIP	8
+
+static bool lowmem_pick_skipped(struct task_struct *p,
+				struct task_struct **skip, int nr_skip)
+{
+	int i;
+
+	for (i = 0; i < nr_skip; i++)
+		if (skip[i] == p)
+			return true;
+	return false;
+}
+
+/*
+ * Pick the largest process from the highest populated bucket at or above
+ * @min_score_adj, ignoring the @nr_skip tasks in @skip, and mark it as the
+ * pending death so that concurrent shrinkers back off.  Returns a
+ * referenced task, NULL if there is no candidate or ERR_PTR(-EBUSY) if an
+ * earlier kill is still in progress.
+ */
+static struct task_struct *lowmem_index_pick(short min_score_adj,
+					     struct task_struct **skip,
+					     int nr_skip)
+{
+	struct task_struct *p, *selected = NULL;
+	unsigned long flags;
+	int bucket, limit = LOWMEM_ADJ_BUCKETS;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	if (lowmem_deathpending &&
+	    time_before_eq(jiffies, lowmem_deathpending_timeout)) {
+		selected = ERR_PTR(-EBUSY);
+		goto out;
+	}
+
+	while (!selected) {
+		bucket = find_last_bit(lowmem_index_map, limit);
+		if (bucket >= limit ||
+		    bucket + OOM_SCORE_ADJ_MIN < min_score_adj)
+			goto out;
+
+		hlist_for_each_entry(p, &lowmem_index[bucket], lmk_node) {
+			if (lowmem_pick_skipped(p, skip, nr_skip))
+				continue;
+			if (!selected || p->lmk_rss > selected->lmk_rss)
+				selected = p;
+		}
+		limit = bucket;
+	}
+	get_task_struct(selected);
+	lowmem_deathpending = selected;
+	lowmem_deathpending_timeout = jiffies + HZ;
+out:
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+	return selected;
+}
+
+/*
+ * Undo the claim taken by lowmem_index_pick() on a candidate that turned
+ * out not to be killable.  Processes that have no memory left to free are
+ * dropped from the index; exit will not find them there anymore.
+ */
+static void lowmem_index_unpick(struct task_struct *p, bool forget)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&lowmem_index_lock, flags);
+	if (forget && !hlist_unhashed(&p->lmk_node))
+		__lowmem_index_remove(p);
+	if (lowmem_deathpending == p)
+		lowmem_deathpending = NULL;
+	spin_unlock_irqrestore(&lowmem_index_lock, flags);
+}
 
 int can_use_cma_pages(gfp_t gfp_mask)
 {
@@ -427,6 +652,7 @@ static void lowmem_wakeup_kswapd(struct shrink_control *sc, int minfree)
 static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 {
 	struct task_struct *tsk;
+	struct task_struct *p;
 	struct task_struct *selected = NULL;
 	int rem = 0;
 	int tasksize;
@@ -443,13 +669,8 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 	int other_free;
 	int other_file;
 	unsigned long nr_to_scan = sc->nr_to_scan;
-
-	if (nr_to_scan > 0) {
-		if (mutex_lock_interruptible(&scan_mutex) < 0) {
-			trace_lmk_remain_scan(0, nr_to_scan, sc->gfp_mask);
-			return 0;
-		};
-	}
+	struct task_struct *skip[LOWMEM_PICK_SKIP];
+	int nr_skip = 0;
 
 	other_free = global_page_state(NR_FREE_PAGES);
 
@@ -468,6 +689,11 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		array_size = lowmem_adj_size;
 	if (lowmem_minfree_size < array_size)
 		array_size = lowmem_minfree_size;
+#ifdef CONFIG_PSI
+	if (enable_psi_lmk)
+		min_score_adj = lowmem_psi_min_adj(array_size);
+	else
+#endif
 	for (i = 0; i < array_size; i++) {
 		minfree = lowmem_minfree[i];
 #ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER_CONSIDER_SWAP
@@ -494,69 +720,62 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 		lowmem_print(5, "lowmem_shrink %lu, %x, return %d\n",
 			     nr_to_scan, sc->gfp_mask, rem);
 
-		if (nr_to_scan > 0)
-			mutex_unlock(&scan_mutex);
-
 		if ((min_score_adj == OOM_SCORE_ADJ_MAX + 1) &&
 			(nr_to_scan > 0))
 			trace_almk_shrink(0, ret, other_free, other_file, 0);
 
 		trace_lmk_remain_scan(rem, nr_to_scan, sc->gfp_mask);
 #ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER_CONSIDER_SWAP
-		lowmem_wakeup_kswapd(sc, max_minfree);
+		/* PSI mode has no minfree watermark to size the wakeup by */
+		if (max_minfree)
+			lowmem_wakeup_kswapd(sc, max_minfree);
 #endif
 		return rem;
 	}
 	selected_oom_score_adj = min_score_adj;
 
+retry:
+	tsk = lowmem_index_pick(min_score_adj, skip, nr_skip);
+	if (IS_ERR(tsk)) {
+		/* give the system time to free up the memory */
+		msleep_interruptible(20);
+		trace_lmk_remain_scan(rem, nr_to_scan, sc->gfp_mask);
+		return 0;
+	}
+
 	rcu_read_lock();
-	for_each_process(tsk) {
-		struct task_struct *p;
+	if (tsk) {
 		short oom_score_adj;
 
-		if (tsk->flags & PF_KTHREAD)
-			continue;
-
 		/* if task no longer has any memory ignore it */
 		if (test_task_flag(tsk, TIF_MM_RELEASED))
-			continue;
-
-		/* Ignore task if coredump in progress */
-		if (tsk->mm && tsk->mm->core_state)
-			continue;
-
-		if (time_before_eq(jiffies, lowmem_deathpending_timeout)) {
-			if (test_task_flag(tsk, TIF_MEMDIE)) {
-				rcu_read_unlock();
-				/* give the system time to free up the memory */
-				msleep_interruptible(20);
-				mutex_unlock(&scan_mutex);
-				trace_lmk_remain_scan(rem, nr_to_scan,
-						      sc->gfp_mask);
-				return 0;
-			}
-		}
+			goto forget;
 
 		p = find_lock_task_mm(tsk);
 		if (!p)
-			continue;
+			goto forget;
 
-		oom_score_adj = p->signal->oom_score_adj;
-		if (oom_score_adj < min_score_adj) {
+		/* Ignore task if coredump in progress */
+		if (p->mm->core_state) {
 			task_unlock(p);
-			continue;
+			goto forget;
 		}
+
+		oom_score_adj = p->signal->oom_score_adj;
 		tasksize = get_mm_rss(p->mm);
 		task_unlock(p);
+		tsk->lmk_rss = tasksize;
 		if (tasksize <= 0)
-			continue;
-		if (selected) {
-			if (oom_score_adj < selected_oom_score_adj)
-				continue;
-			if (oom_score_adj == selected_oom_score_adj &&
-			    tasksize <= selected_tasksize)
-				continue;
+			goto skip;
+
+		/* adj was lowered after the pick, it has been rebucketed */
+		if (oom_score_adj < min_score_adj) {
+			rcu_read_unlock();
+			lowmem_index_unpick(tsk, false);
+			put_task_struct(tsk);
+			goto retry;
 		}
+
 		selected = p;
 		selected_tasksize = tasksize;
 		selected_oom_score_adj = oom_score_adj;
@@ -610,11 +829,17 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 			show_mem_call_notifiers();
 		}
 
-		lowmem_deathpending_timeout = jiffies + HZ;
 		send_sig(SIGKILL, selected, 0);
 		set_tsk_thread_flag(selected, TIF_MEMDIE);
+		wake_oom_reaper(selected);
+#ifdef CONFIG_PSI
+		if (enable_psi_lmk)
+			lowmem_psi_holdoff = jiffies +
+				msecs_to_jiffies(psi_holdoff_ms);
+#endif
 		rem -= selected_tasksize;
 		rcu_read_unlock();
+		put_task_struct(tsk);
 		trace_lmk_sigkill(selected->pid, selected->comm,
 				 selected_oom_score_adj, selected_tasksize,
 				 sc->gfp_mask);
@@ -629,7 +854,25 @@ static int lowmem_shrink(struct shrinker *s, struct shrink_control *sc)
 
 	lowmem_print(4, "lowmem_shrink %lu, %x, return %d\n",
 		     nr_to_scan, sc->gfp_mask, rem);
-	mutex_unlock(&scan_mutex);
+	trace_lmk_remain_scan(rem, nr_to_scan, sc->gfp_mask);
+	return rem;
+
+forget:
+	rcu_read_unlock();
+	lowmem_index_unpick(tsk, true);
+	put_task_struct(tsk);
+	goto retry;
+
+skip:
+	/* no rss right now, may have some again later: pass over it */
+	rcu_read_unlock();
+	lowmem_index_unpick(tsk, false);
+	put_task_struct(tsk);
+	if (nr_skip < LOWMEM_PICK_SKIP) {
+		skip[nr_skip++] = tsk;
+		goto retry;
+	}
+	trace_almk_shrink(1, ret, other_free, other_file, 0);
 	trace_lmk_remain_scan(rem, nr_to_scan, sc->gfp_mask);
 	return rem;
 }
@@ -952,6 +952,7 @@ static int de_thread(struct task_struct *tsk)
 		transfer_pid(leader, tsk, PIDTYPE_SID);
 
 		list_replace_rcu(&leader->tasks, &tsk->tasks);
+		lowmem_index_replace(leader, tsk);
 		list_replace_init(&leader->sibling, &tsk->sibling);
 
 		tsk->group_leader = tsk;
@@ -1088,6 +1089,7 @@ int flush_old_exec(struct linux_binprm * bprm)
 	set_fs(USER_DS);
 	current->flags &=
 		~(PF_RANDOMIZE | PF_FORKNOEXEC | PF_KTHREAD | PF_NOFREEZE);
+	lowmem_index_add(current);
 	flush_thread();
 	current->personality &= ~bprm->per_clear;
 
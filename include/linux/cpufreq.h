@@ -78,6 +78,14 @@ struct cpufreq_policy {
 	void			*governor_data;
 	bool			governor_enabled; /* governor start/stop flag */
 
+	/*
+	 * Set by the driver if ->fast_switch() may be used for this policy,
+	 * fast_switch_enabled is set by the governor through
+	 * cpufreq_enable_fast_switch().
+	 */
+	bool			fast_switch_possible;
+	bool			fast_switch_enabled;
+
 	struct work_struct	update; /* if update_policy() needs to be
 					 * called, but you're in IRQ context */
 
@@ -218,6 +226,13 @@ struct cpufreq_driver {
 				 unsigned int relation);
 	int	(*target_index)	(struct cpufreq_policy *policy,
 				 unsigned int index);
+	/*
+	 * Optional, switch to the frequency closest at or above target_freq
+	 * without sleeping, from any context, and return the new frequency
+	 * or 0 on failure.
+	 */
+	unsigned int	(*fast_switch)	(struct cpufreq_policy *policy,
+					 unsigned int target_freq);
 
 	/* should be defined, if possible */
 	unsigned int	(*get)	(unsigned int cpu);
@@ -419,6 +434,10 @@ int cpufreq_driver_target(struct cpufreq_policy *policy,
 int __cpufreq_driver_target(struct cpufreq_policy *policy,
 				   unsigned int target_freq,
 				   unsigned int relation);
+unsigned int cpufreq_driver_fast_switch(struct cpufreq_policy *policy,
+					unsigned int target_freq);
+void cpufreq_enable_fast_switch(struct cpufreq_policy *policy);
+void cpufreq_disable_fast_switch(struct cpufreq_policy *policy);
 extern int __cpufreq_driver_getavg(struct cpufreq_policy *policy,
                                   unsigned int cpu);					   
 int cpufreq_register_governor(struct cpufreq_governor *governor);
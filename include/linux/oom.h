@@ -87,10 +87,52 @@ static inline void oom_killer_enable(void)
 
 extern struct task_struct *find_lock_task_mm(struct task_struct *p);
 
+#ifdef CONFIG_MMU
+extern void wake_oom_reaper(struct task_struct *tsk);
+#else
+static inline void wake_oom_reaper(struct task_struct *tsk)
+{
+}
+#endif
+
 extern void dump_tasks(const struct mem_cgroup *memcg,
 		const nodemask_t *nodemask);
 
 /* sysctls */
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+/*
+ * The lowmemorykiller keeps thread group leaders in an index bucketed by
+ * oom_score_adj so that it never has to walk the whole task list.  The
+ * index mirrors the tasks list and is updated wherever that list changes.
+ */
+static inline void lowmem_index_init(struct task_struct *p)
+{
+	INIT_HLIST_NODE(&p->lmk_node);
+}
+extern void lowmem_index_add(struct task_struct *p);
+extern void lowmem_index_del(struct task_struct *p);
+extern void lowmem_index_replace(struct task_struct *old,
+				 struct task_struct *new);
+extern void lowmem_index_update(struct task_struct *task);
+#else
+static inline void lowmem_index_init(struct task_struct *p)
+{
+}
+static inline void lowmem_index_add(struct task_struct *p)
+{
+}
+static inline void lowmem_index_del(struct task_struct *p)
+{
+}
+static inline void lowmem_index_replace(struct task_struct *old,
+					struct task_struct *new)
+{
+}
+static inline void lowmem_index_update(struct task_struct *task)
+{
+}
+#endif
+
 extern int sysctl_oom_dump_tasks;
 extern int sysctl_oom_kill_allocating_task;
 extern int sysctl_panic_on_oom;
@@ -0,0 +1,46 @@
+#ifndef _LINUX_PSI_H
+#define _LINUX_PSI_H
+
+#include <linux/types.h>
+
+/*
+ * Memory pressure stall states tracked per CPU.  SOME means at least one
+ * task is stalled on memory, FULL means no other runnable task is making
+ * progress on the CPU at the same time.  NONIDLE is the time the CPU had
+ * any work at all and is used to weight the per-CPU samples.
+ */
+enum psi_states {
+	PSI_MEM_SOME,
+	PSI_MEM_FULL,
+	PSI_NONIDLE,
+	NR_PSI_STATES,
+};
+
+/* Running average windows */
+enum psi_avgs {
+	PSI_AVG10,
+	PSI_AVG60,
+	PSI_AVG300,
+	NR_PSI_AVGS,
+};
+
+#ifdef CONFIG_PSI
+extern void psi_memstall_enter(unsigned long *flags);
+extern void psi_memstall_leave(unsigned long *flags);
+extern unsigned int psi_mem_pressure(enum psi_states state,
+				     enum psi_avgs window);
+#else
+static inline void psi_memstall_enter(unsigned long *flags)
+{
+}
+static inline void psi_memstall_leave(unsigned long *flags)
+{
+}
+static inline unsigned int psi_mem_pressure(enum psi_states state,
+					    enum psi_avgs window)
+{
+	return 0;
+}
+#endif
+
+#endif /* _LINUX_PSI_H */
@@ -187,7 +187,7 @@ extern void sched_get_nr_running_avg(int *avg, int *iowait_avg, int *big_avg);
 extern void calc_global_load(unsigned long ticks);
 extern void update_cpu_load_nohz(void);
 
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
 extern unsigned long avg_nr_running(void);
 extern unsigned long avg_cpu_nr_running(unsigned int cpu);
 #endif
@@ -1362,6 +1362,8 @@ struct task_struct {
 	const struct sched_class *sched_class;
 	struct sched_entity se;
 	struct sched_rt_entity rt;
+	/* local_clock() deadline of a frame-critical task, 0 if none */
+	u64 frame_deadline;
 #ifdef CONFIG_SCHED_HMP
 	struct ravg ravg;
 	/*
@@ -1412,12 +1414,21 @@ struct task_struct {
 #endif
 
 	struct list_head tasks;
+#ifdef CONFIG_ANDROID_LOW_MEMORY_KILLER
+	struct hlist_node lmk_node;	/* lowmemorykiller oom_score_adj index */
+	short lmk_adj;
+	unsigned long lmk_rss;
+#endif
 #ifdef CONFIG_SMP
 	struct plist_node pushable_tasks;
 	struct rb_node pushable_dl_tasks;
 #endif
 
 	struct mm_struct *mm, *active_mm;
+#ifdef CONFIG_MMU
+	struct task_struct *oom_reaper_list;	/* queued for the oom reaper */
+	u64 oom_reap_queued;	/* local_clock() at kill, 0 if not queued */
+#endif
 #ifdef CONFIG_COMPAT_BRK
 	unsigned brk_randomized:1;
 #endif
@@ -1445,6 +1456,12 @@ struct task_struct {
 	unsigned sched_reset_on_fork:1;
 	unsigned sched_contributes_to_load:1;
 
+#ifdef CONFIG_PSI
+	/* Stalled due to lack of memory, charged to memstall_cpu */
+	unsigned int in_memstall;
+	int memstall_cpu;
+#endif
+
 	unsigned long atomic_flags; /* Flags needing atomic access. */
 
 	pid_t pid;
@@ -1721,6 +1738,9 @@ struct task_struct {
 #ifdef	CONFIG_TASK_DELAY_ACCT
 	struct task_delay_info *delays;
 #endif
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	u64 energy;	/* estimated busy energy, in nJ */
+#endif
 #ifdef CONFIG_FAULT_INJECTION
 	int make_it_fail;
 #endif
@@ -2244,7 +2264,22 @@ extern void sched_set_cpu_cstate(int cpu, int cstate,
 			 int wakeup_energy, int wakeup_latency);
 extern void sched_set_cluster_dstate(const cpumask_t *cluster_cpus, int dstate,
 				int wakeup_energy, int wakeup_latency);
+
+extern struct cpumask __cpu_isolated_mask;
+#define cpu_isolated_mask	((const struct cpumask *)&__cpu_isolated_mask)
+#define cpu_isolated(cpu)	cpumask_test_cpu((cpu), cpu_isolated_mask)
+extern int sched_isolate_cpu(int cpu);
+extern int sched_unisolate_cpu(int cpu);
 #else
+#define cpu_isolated(cpu)	0
+static inline int sched_isolate_cpu(int cpu)
+{
+	return -EINVAL;
+}
+static inline int sched_unisolate_cpu(int cpu)
+{
+	return 0;
+}
 static inline void do_set_cpus_allowed(struct task_struct *p,
 				      const struct cpumask *new_mask)
 {
@@ -2455,6 +2490,7 @@ extern int sched_setscheduler_nocheck(struct task_struct *, int,
 				      const struct sched_param *);
 extern int sched_setattr(struct task_struct *,
 			 const struct sched_attr *);
+extern int sched_set_frame_hint(struct task_struct *p, unsigned long deadline_us);
 extern struct task_struct *idle_task(int cpu);
 /**
  * is_idle_task - is the specified task an idle task?
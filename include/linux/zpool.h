@@ -36,6 +36,8 @@ enum zpool_mapmode {
 	ZPOOL_MM_DEFAULT = ZPOOL_MM_RW
 };
 
+bool zpool_has_pool(char *type);
+
 struct zpool *zpool_create_pool(char *type, char *name,
 			gfp_t gfp, struct zpool_ops *ops);
 
@@ -60,6 +62,8 @@ u64 zpool_get_total_size(struct zpool *pool);
 
 unsigned long zpool_compact(struct zpool *pool);
 
+unsigned long zpool_get_compacted_pages(struct zpool *pool);
+
 /**
  * struct zpool_driver - driver implementation for zpool
  * @type:	name of the driver.
@@ -99,6 +103,7 @@ struct zpool_driver {
 	u64 (*total_size)(void *pool);
 
 	unsigned long (*compact)(void *pool);
+	unsigned long (*compacted_pages)(void *pool);
 };
 
 void zpool_register_driver(struct zpool_driver *driver);
@@ -20,6 +20,8 @@ extern s64 core_ctl_get_time(void);
 extern struct cpufreq_policy *core_ctl_get_policy(int cpu);
 extern void core_ctl_put_policy(struct cpufreq_policy *policy);
 extern struct device *core_ctl_find_cpu_device(unsigned cpu);
-extern int core_ctl_online_core(unsigned int cpu);
+extern int core_ctl_isolate_core(unsigned int cpu);
+extern int core_ctl_unisolate_core(unsigned int cpu);
+extern unsigned int core_ctl_nr_running_avg(unsigned int cpu);
 
 #endif
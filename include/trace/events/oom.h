@@ -68,6 +68,63 @@ DEFINE_EVENT(oom_kill, oom_sigkill,
 	TP_ARGS(pid, comm, score, size, gfp_mask)
 );
 
+DECLARE_EVENT_CLASS(oom_reap,
+	TP_PROTO(int pid),
+	TP_ARGS(pid),
+
+	TP_STRUCT__entry(
+		__field(int, pid)
+	),
+
+	TP_fast_assign(
+		__entry->pid = pid;
+	),
+
+	TP_printk("pid=%d", __entry->pid)
+);
+
+DEFINE_EVENT(oom_reap, wake_reaper,
+	TP_PROTO(int pid),
+	TP_ARGS(pid)
+);
+
+DEFINE_EVENT(oom_reap, start_task_reaping,
+	TP_PROTO(int pid),
+	TP_ARGS(pid)
+);
+
+DEFINE_EVENT(oom_reap, skip_task_reaping,
+	TP_PROTO(int pid),
+	TP_ARGS(pid)
+);
+
+TRACE_EVENT(finish_task_reaping,
+	TP_PROTO(int pid,
+		 unsigned long rss_before,
+		 unsigned long rss_after,
+		 u64 delay_ns),
+	TP_ARGS(pid, rss_before, rss_after, delay_ns),
+
+	TP_STRUCT__entry(
+		__field(int, pid)
+		__field(unsigned long, rss_before)
+		__field(unsigned long, rss_after)
+		__field(u64, delay_ns)
+	),
+
+	TP_fast_assign(
+		__entry->pid		= pid;
+		__entry->rss_before	= rss_before;
+		__entry->rss_after	= rss_after;
+		__entry->delay_ns	= delay_ns;
+	),
+
+	TP_printk("pid=%d rss_before=%lu rss_after=%lu freed=%lu delay_us=%llu",
+		  __entry->pid, __entry->rss_before, __entry->rss_after,
+		  __entry->rss_before - __entry->rss_after,
+		  div_u64(__entry->delay_ns, NSEC_PER_USEC))
+);
+
 
 
 #endif
@@ -0,0 +1,57 @@
+/* cpufreq_stats.h - binary cpufreq transition ring
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _UAPI_LINUX_CPUFREQ_STATS_H
+#define _UAPI_LINUX_CPUFREQ_STATS_H
+
+#include <linux/types.h>
+
+/*
+ * Every cpu owns a ring of frequency transition events, readable and
+ * mmap-able (read-only) through
+ *
+ *	/sys/devices/system/cpu/cpuN/cpufreq_trans_ring
+ *
+ * The mapping starts with a struct cpufreq_trans_ring_hdr, followed by
+ * hdr.nr_entries records of hdr.entry_size bytes each. The record with
+ * sequence number seq (starting at 1) lives in slot (seq - 1) % nr_entries.
+ *
+ * The kernel never waits for readers. To read record seq:
+ *	1. read entry->seq, stop unless it equals seq
+ *	2. read barrier, copy the record
+ *	3. read barrier, re-read entry->seq: if it changed the record was
+ *	   overwritten while being copied and has to be dropped
+ * hdr.head is the highest sequence number handed out so far; records up to
+ * it may still be in flight (entry->seq not yet equal to their number).
+ *
+ * Bump CPUFREQ_TRANS_RING_VERSION when changing the layout; new fields are
+ * only ever added to the end of struct cpufreq_trans_event.
+ */
+#define CPUFREQ_TRANS_RING_VERSION	1
+#define CPUFREQ_TRANS_GOV_LEN		16
+
+struct cpufreq_trans_ring_hdr {
+	__u32	version;
+	__u32	nr_entries;
+	__u32	entry_size;
+	__u32	cpu;
+	__u64	head;
+	__u64	__reserved[5];
+};
+
+struct cpufreq_trans_event {
+	__u64	seq;		/* 0: slot never written */
+	__u64	time_ns;	/* CLOCK_MONOTONIC */
+	__u32	cpu;
+	__u32	old_freq;	/* kHz */
+	__u32	new_freq;	/* kHz */
+	__u32	flags;		/* cpufreq driver flags */
+	char	governor[CPUFREQ_TRANS_GOV_LEN];
+	__u64	__reserved[2];
+};
+
+#endif /* _UAPI_LINUX_CPUFREQ_STATS_H */
@@ -158,4 +158,10 @@
 #define PR_SET_VMA		0x53564d41
 # define PR_SET_VMA_ANON_NAME		0
 
+/* Marks a thread frame-critical until a deadline
+ * arg2 deadline in microseconds from now, at most one second, 0 clears it
+ * arg3 pid of the thread to mark, 0 means the calling thread
+ */
+#define PR_SET_FRAME_HINT	0x46524d48
+
 #endif /* _LINUX_PRCTL_H */
@@ -33,7 +33,7 @@
  */
 
 
-#define TASKSTATS_VERSION	8
+#define TASKSTATS_VERSION	9
 #define TS_COMM_LEN		32	/* should be >= TASK_COMM_LEN
 					 * in linux/sched.h */
 
@@ -163,6 +163,14 @@ struct taskstats {
 	/* Delay waiting for memory reclaim */
 	__u64	freepages_count;
 	__u64	freepages_delay_total;
+
+	/* version 8 ends here */
+
+	/*
+	 * Busy energy estimated from the scheduler energy model, in busy
+	 * cost * usec; the model costs are normalized, not physical units.
+	 */
+	__u64	energy;
 };
 
 
@@ -158,6 +158,11 @@ int __delayacct_add_tsk(struct taskstats *d, struct task_struct *tsk)
 	d->freepages_count += tsk->delays->freepages_count;
 	spin_unlock_irqrestore(&tsk->delays->lock, flags);
 
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	tmp = d->energy + tsk->energy;
+	d->energy = (tmp < d->energy) ? 0 : tmp;
+#endif
+
 done:
 	return 0;
 }
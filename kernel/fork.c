@@ -1292,6 +1292,11 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 	copy_flags(clone_flags, p);
 	INIT_LIST_HEAD(&p->children);
 	INIT_LIST_HEAD(&p->sibling);
+	lowmem_index_init(p);
+#ifdef CONFIG_MMU
+	p->oom_reaper_list = NULL;
+	p->oom_reap_queued = 0;
+#endif
 	rcu_copy_process(p);
 	p->vfork_done = NULL;
 	spin_lock_init(&p->alloc_lock);
@@ -1534,6 +1539,7 @@ static struct task_struct *copy_process(unsigned long clone_flags,
 			attach_pid(p, PIDTYPE_SID, task_session(current));
 			list_add_tail(&p->sibling, &p->real_parent->children);
 			list_add_tail_rcu(&p->tasks, &init_task.tasks);
+			lowmem_index_add(p);
 			__this_cpu_inc(process_counts);
 		} else {
 			current->signal->nr_threads++;
@@ -118,7 +118,7 @@ void start_bandwidth_timer(struct hrtimer *period_timer, ktime_t period)
 DEFINE_MUTEX(sched_domains_mutex);
 DEFINE_PER_CPU_SHARED_ALIGNED(struct rq, runqueues);
 
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
 DEFINE_PER_CPU_SHARED_ALIGNED(struct nr_stats_s, runqueue_stats);
 #endif
 
@@ -851,6 +851,7 @@ static void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 	update_rq_clock(rq);
 	sched_info_queued(rq, p);
 	p->sched_class->enqueue_task(rq, p, flags);
+	psi_enqueue(rq, p);
 }
 
 static void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
@@ -858,6 +859,7 @@ static void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 	update_rq_clock(rq);
 	sched_info_dequeued(rq, p);
 	p->sched_class->dequeue_task(rq, p, flags);
+	psi_dequeue(rq, p);
 }
 
 void activate_task(struct rq *rq, struct task_struct *p, int flags)
@@ -1371,6 +1373,8 @@ static int select_fallback_rq(int cpu, struct task_struct *p)
 				continue;
 			if (!cpu_active(dest_cpu))
 				continue;
+			if (cpu_isolated(dest_cpu))
+				continue;
 			if (cpumask_test_cpu(dest_cpu, tsk_cpus_allowed(p)))
 				return dest_cpu;
 		}
@@ -1378,6 +1382,20 @@ static int select_fallback_rq(int cpu, struct task_struct *p)
 
 	for (;;) {
 		/* Any allowed, online CPU? */
+		for_each_cpu(dest_cpu, tsk_cpus_allowed(p)) {
+			if (!cpu_online(dest_cpu))
+				continue;
+			if (!cpu_active(dest_cpu))
+				continue;
+			if (cpu_isolated(dest_cpu))
+				continue;
+			goto out;
+		}
+
+		/*
+		 * Only isolated cpus left in the mask: running there beats
+		 * breaking the task's affinity.
+		 */
 		for_each_cpu(dest_cpu, tsk_cpus_allowed(p)) {
 			if (!cpu_online(dest_cpu))
 				continue;
@@ -1439,7 +1457,7 @@ int select_task_rq(struct task_struct *p, int cpu, int sd_flags, int wake_flags)
 	 *   not worry about this generic constraint ]
 	 */
 	if (unlikely(!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)) ||
-		     !cpu_online(cpu)))
+		     !cpu_online(cpu) || cpu_isolated(cpu)))
 		cpu = select_fallback_rq(task_cpu(p), p);
 
 	return cpu;
@@ -1859,6 +1877,13 @@ void __dl_clear_params(struct task_struct *p)
 static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 {
 	p->on_rq			= 0;
+#ifdef CONFIG_PSI
+	p->in_memstall			= 0;
+#endif
+	p->frame_deadline		= 0;
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	p->energy			= 0;
+#endif
 
 	p->se.on_rq			= 0;
 	p->se.exec_start		= 0;
@@ -2437,7 +2462,7 @@ unsigned long nr_running(void)
 	return sum;
 }
 
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
 unsigned long avg_nr_running(void)
 {
  	unsigned long i, sum = 0;
@@ -3910,6 +3935,27 @@ int sched_setscheduler_nocheck(struct task_struct *p, int policy,
 	return _sched_setscheduler(p, policy, param, false);
 }
 
+/**
+ * sched_set_frame_hint - mark a task frame-critical until a deadline
+ * @p: the task in question.
+ * @deadline_us: deadline in microseconds from now, 0 clears the hint.
+ *
+ * Until the deadline passes the fair class boosts the utilization of @p by
+ * sysctl_sched_frame_boost and places it on the biggest cpus.
+ *
+ * Return: 0 on success. -EINVAL if the deadline is more than a second away.
+ */
+int sched_set_frame_hint(struct task_struct *p, unsigned long deadline_us)
+{
+	if (deadline_us > USEC_PER_SEC)
+		return -EINVAL;
+
+	p->frame_deadline = deadline_us ?
+		local_clock() + deadline_us * NSEC_PER_USEC : 0;
+
+	return 0;
+}
+
 static int
 do_sched_setscheduler(pid_t pid, int policy, struct sched_param __user *param)
 {
@@ -5098,6 +5144,150 @@ static int migration_cpu_stop(void *data)
 	return 0;
 }
 
+/*
+ * Runtime cpu isolation. An isolated cpu stays online, keeps servicing its
+ * interrupts, timers and pinned kthreads, but the scheduler stops placing
+ * work on it: wakeups and forks avoid it, it never pulls during load
+ * balancing, and the fair tasks queued on it at isolation time are pushed
+ * away. Un-isolating is a cpumask update; the load balancer refills the cpu.
+ */
+struct cpumask __cpu_isolated_mask __read_mostly;
+EXPORT_SYMBOL_GPL(__cpu_isolated_mask);
+
+static DEFINE_MUTEX(sched_isolation_mutex);
+
+/*
+ * Pick the least loaded active, non-isolated cpu @p may move to, preferring
+ * the cpus sharing a cluster with @src_cpu on ties.
+ */
+static int isolation_dest_cpu(struct task_struct *p, int src_cpu)
+{
+	unsigned int nr, best_nr = UINT_MAX;
+	int cpu, best_cpu = -1;
+
+	for_each_cpu_and(cpu, tsk_cpus_allowed(p), cpu_active_mask) {
+		if (cpu == src_cpu || cpu_isolated(cpu))
+			continue;
+
+		nr = cpu_rq(cpu)->nr_running;
+		if (nr < best_nr || (nr == best_nr &&
+		    cpumask_test_cpu(cpu, cpu_coregroup_mask(src_cpu)))) {
+			best_nr = nr;
+			best_cpu = cpu;
+		}
+	}
+
+	return best_cpu;
+}
+
+/*
+ * Runs in the stopper of the cpu being isolated, so that nothing but the
+ * stopper itself is running there while its fair tasks are moved away.
+ * Tasks without any other allowed cpu stay; other classes leave on their
+ * next wakeup through select_task_rq().
+ */
+static int sched_isolate_cpu_stop(void *data)
+{
+	int cpu = smp_processor_id();
+	struct rq *rq = cpu_rq(cpu);
+	struct task_struct *p, *next;
+	unsigned int budget;
+	int dest_cpu;
+
+	local_irq_disable();
+	sched_ttwu_pending();
+
+	budget = rq->nr_running;
+	while (budget--) {
+		dest_cpu = -1;
+		next = NULL;
+
+		raw_spin_lock(&rq->lock);
+		list_for_each_entry(p, &rq->cfs_tasks, se.group_node) {
+			if (task_running(rq, p))
+				continue;
+
+			dest_cpu = isolation_dest_cpu(p, cpu);
+			if (dest_cpu >= 0) {
+				next = p;
+				get_task_struct(next);
+				break;
+			}
+		}
+		raw_spin_unlock(&rq->lock);
+
+		if (!next)
+			break;
+
+		__migrate_task(next, cpu, dest_cpu);
+		put_task_struct(next);
+	}
+
+	local_irq_enable();
+	return 0;
+}
+
+/**
+ * sched_isolate_cpu - stop scheduling work on an online cpu
+ * @cpu: the cpu to isolate
+ *
+ * Refuses to isolate the last active, non-isolated cpu.
+ *
+ * Return: 0 on success, -EINVAL for an inactive cpu, -EBUSY if @cpu is the
+ * last one left to run tasks.
+ */
+int sched_isolate_cpu(int cpu)
+{
+	struct cpumask avail;
+	int ret = 0;
+
+	mutex_lock(&sched_isolation_mutex);
+
+	if (!cpu_active(cpu)) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	if (cpu_isolated(cpu))
+		goto out;
+
+	cpumask_andnot(&avail, cpu_active_mask, cpu_isolated_mask);
+	cpumask_clear_cpu(cpu, &avail);
+	if (cpumask_empty(&avail)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	cpumask_set_cpu(cpu, &__cpu_isolated_mask);
+	/* Order the mask update before the stopper looks at the runqueue */
+	smp_mb();
+	stop_one_cpu(cpu, sched_isolate_cpu_stop, NULL);
+out:
+	mutex_unlock(&sched_isolation_mutex);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(sched_isolate_cpu);
+
+/**
+ * sched_unisolate_cpu - let the scheduler use an isolated cpu again
+ * @cpu: the cpu to un-isolate
+ *
+ * Return: 0. Un-isolating a cpu which is not isolated is a no-op.
+ */
+int sched_unisolate_cpu(int cpu)
+{
+	mutex_lock(&sched_isolation_mutex);
+	cpumask_clear_cpu(cpu, &__cpu_isolated_mask);
+	mutex_unlock(&sched_isolation_mutex);
+
+	/* Kick the cpu out of idle so that it pulls work right away */
+	if (cpu_online(cpu))
+		resched_cpu(cpu);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_unisolate_cpu);
+
 #ifdef CONFIG_HOTPLUG_CPU
 
 /*
@@ -5522,6 +5712,8 @@ migration_call(struct notifier_block *nfb, unsigned long action, void *hcpu)
 
 	case CPU_DEAD:
 		calc_load_migrate(rq);
+		/* A cpu always comes back online un-isolated */
+		cpumask_clear_cpu(cpu, &__cpu_isolated_mask);
 		break;
 #endif
 	}
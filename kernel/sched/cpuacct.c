@@ -31,6 +31,10 @@ struct cpuacct {
 	/* cpuusage holds pointer to a u64-type object on every cpu */
 	u64 __percpu *cpuusage;
 	struct kernel_cpustat __percpu *cpustat;
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	/* estimated busy energy in model cost * usec, charged like cpuusage */
+	u64 __percpu *energy;
+#endif
 };
 
 static inline struct cpuacct *css_ca(struct cgroup_subsys_state *css)
@@ -63,9 +67,15 @@ static inline struct cpuacct *parent_ca(struct cpuacct *ca)
 }
 
 static DEFINE_PER_CPU(u64, root_cpuacct_cpuusage);
+#ifdef CONFIG_TASK_ENERGY_ACCT
+static DEFINE_PER_CPU(u64, root_cpuacct_energy);
+#endif
 static struct cpuacct root_cpuacct = {
 	.cpustat	= &kernel_cpustat,
 	.cpuusage	= &root_cpuacct_cpuusage,
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	.energy		= &root_cpuacct_energy,
+#endif
 };
 
 /* create a new cpu accounting group */
@@ -88,8 +98,18 @@ static struct cgroup_subsys_state *cpuacct_css_alloc(struct cgroup *cgrp)
 	if (!ca->cpustat)
 		goto out_free_cpuusage;
 
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	ca->energy = alloc_percpu(u64);
+	if (!ca->energy)
+		goto out_free_cpustat;
+#endif
+
 	return &ca->css;
 
+#ifdef CONFIG_TASK_ENERGY_ACCT
+out_free_cpustat:
+	free_percpu(ca->cpustat);
+#endif
 out_free_cpuusage:
 	free_percpu(ca->cpuusage);
 out_free_ca:
@@ -103,6 +123,9 @@ static void cpuacct_css_free(struct cgroup *cgrp)
 {
 	struct cpuacct *ca = cgroup_ca(cgrp);
 
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	free_percpu(ca->energy);
+#endif
 	free_percpu(ca->cpustat);
 	free_percpu(ca->cpuusage);
 	kfree(ca);
@@ -189,6 +212,30 @@ static int cpuacct_percpu_seq_show(struct cgroup *cgroup, struct cftype *cft, st
 	return 0;
 }
 
+#ifdef CONFIG_TASK_ENERGY_ACCT
+/* return total estimated busy energy (in model cost * usec) of a group */
+static u64 energy_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct cpuacct *ca = cgroup_ca(cgrp);
+	u64 total = 0;
+	int i;
+
+	for_each_present_cpu(i) {
+		u64 *energy = per_cpu_ptr(ca->energy, i);
+
+#ifndef CONFIG_64BIT
+		raw_spin_lock_irq(&cpu_rq(i)->lock);
+		total += *energy;
+		raw_spin_unlock_irq(&cpu_rq(i)->lock);
+#else
+		total += *energy;
+#endif
+	}
+
+	return total;
+}
+#endif
+
 static const char * const cpuacct_stat_desc[] = {
 	[CPUACCT_STAT_USER] = "user",
 	[CPUACCT_STAT_SYSTEM] = "system",
@@ -237,6 +284,12 @@ static struct cftype files[] = {
 		.name = "stat",
 		.read_map = cpuacct_stats_show,
 	},
+#ifdef CONFIG_TASK_ENERGY_ACCT
+	{
+		.name = "energy",
+		.read_u64 = energy_read,
+	},
+#endif
 	{ }	/* terminate */
 };
 
@@ -268,6 +321,25 @@ void cpuacct_charge(struct task_struct *tsk, u64 cputime)
 	rcu_read_unlock();
 }
 
+#ifdef CONFIG_TASK_ENERGY_ACCT
+/*
+ * charge the energy estimated for a slice of this task's execution to its
+ * accounting group and all of its parents.
+ *
+ * called with rq->lock held.
+ */
+void cpuacct_charge_energy(struct task_struct *tsk, u64 energy)
+{
+	struct cpuacct *ca;
+	int cpu = task_cpu(tsk);
+
+	rcu_read_lock();
+	for (ca = task_ca(tsk); ca; ca = parent_ca(ca))
+		*per_cpu_ptr(ca->energy, cpu) += energy;
+	rcu_read_unlock();
+}
+#endif
+
 /*
  * Add user/system time to cpuacct.
  *
@@ -15,6 +15,7 @@
 #include <linux/lcd_notify.h>
 
 #include "sched.h"
+#include "tune.h"
 
 #define THROTTLE_NSEC_UP		40000000 	/* 40ms default */
 
@@ -22,49 +23,98 @@
 
 #define THROTTLE_NSEC_SLEEP		12500000 	/* 12.5ms default to enter idle faster*/
 
+#define DEMAND_WINDOW_NSEC		20000000	/* 20ms default */
+
+#define DEMAND_HIST_SIZE		5
+
+enum demand_policy {
+	DEMAND_POLICY_NONE,	/* use the instantaneous request only */
+	DEMAND_POLICY_MAX,	/* max of the window history */
+	DEMAND_POLICY_AVG,	/* average of the window history */
+	DEMAND_POLICY_RECENT,	/* average weighted towards recent windows */
+	DEMAND_POLICY_NR,
+};
+
+static const char * const demand_policy_names[DEMAND_POLICY_NR] = {
+	[DEMAND_POLICY_NONE]	= "none",
+	[DEMAND_POLICY_MAX]	= "max",
+	[DEMAND_POLICY_AVG]	= "avg",
+	[DEMAND_POLICY_RECENT]	= "recent",
+};
+
+/**
+ * cpu_demand - per-cpu windowed history of capacity requests
+ * @window_start: start of the current window in ns
+ * @last_update: time @cur_cap was last accounted in ns
+ * @window_sum: capacity * ns requested so far in the current window
+ * @cur_cap: capacity requested since @last_update
+ * @hist: time-weighted average capacity of the last completed windows
+ * @hist_idx: slot of the most recent window in @hist
+ * @window: window length in ns, the policy's demand_window_ns
+ *
+ * Only touched by cpufreq_sched_set_cap() and cpufreq_sched_reset_cap() for
+ * the cpu itself, which the scheduler calls with that cpu's rq lock held.
+ * Other cpus of the policy read it locklessly when predicting demand, and
+ * account the windows the cpu has not closed yet at @cur_cap.
+ */
+struct cpu_demand {
+	unsigned int window;
+	u64 window_start;
+	u64 last_update;
+	u64 window_sum;
+	unsigned long cur_cap;
+	unsigned long hist[DEMAND_HIST_SIZE];
+	unsigned int hist_idx;
+};
+
 static DEFINE_PER_CPU(unsigned long, pcpu_capacity);
+static DEFINE_PER_CPU(struct cpu_demand, pcpu_demand);
 static DEFINE_PER_CPU(struct cpufreq_policy *, pcpu_policy);
 static DEFINE_PER_CPU(int, governor_started);
 
+#define SCREEN_OFF_MAX_FREQ		384000
+
 /**
  * gov_data - per-policy data internal to the governor
  * @throttle: next throttling period expiry. Derived from throttle_nsec
  * @throttle_nsec: throttle period length in nanoseconds
+ * @screen_off_max_freq: frequency cap applied while the display is off
+ * @demand_policy: how the window history of each cpu predicts its demand
+ * @demand_window_nsec: length of the history windows of this policy's cpus
  * @freq: new frequency stored in *_sched_update_cpu and used in *_sched_thread
+ * @prev_freq: last frequency requested for this policy
+ * @task: worker thread for dvfs transitions that may block/sleep
+ * @irq_work: callback used to wake up @task from scheduler context
  *
  * struct gov_data is the per-policy cpufreq_sched-specific data structure. A
  * per-policy instance of it is created when the cpufreq_sched governor receives
- * the CPUFREQ_GOV_START condition and a pointer to it exists in the gov_data
- * member of struct cpufreq_policy.
+ * the CPUFREQ_GOV_POLICY_INIT condition and a pointer to it exists in the
+ * gov_data member of struct cpufreq_policy. Each cluster ramps independently,
+ * nothing in here is shared between policies.
  *
  * Readers of this data must call down_read(policy->rwsem). Writers must
- * call down_write(policy->rwsem).
+ * call down_write(policy->rwsem), except on the fast switch path which runs
+ * from the scheduler with the rq lock held and only touches @throttle and
+ * @prev_freq.
  */
 struct gov_data {
 	ktime_t throttle;
 	unsigned int throttle_nsec_up;
 	unsigned int throttle_nsec_down;
 	unsigned int throttle_nsec_sleep;
+	unsigned int screen_off_max_freq;
+	enum demand_policy demand_policy;
+	unsigned int demand_window_nsec;
 	struct cpufreq_policy *policy;
 	unsigned int freq;
+	unsigned int prev_freq;
 	bool change_pending;
-	struct list_head gov_list;
+	struct task_struct *task;
+	struct irq_work irq_work;
 };
 
- /* worker thread for dvfs transition that may block/sleep */
-static struct task_struct *freq_change_task;
-static LIST_HEAD(sched_gov_list);
-static struct mutex gov_list_lock;
-
-/* irq_work: callback used to wake up worker thread */
-static struct irq_work irq_work;
-
 static int sched_priority = 50; 
 
-static unsigned int screen_off_max_freq = 384000;
-
-static unsigned int previous_freq = 0;
-
 static struct notifier_block lcd_notifier_hook;
 static bool display_online;
 
@@ -85,40 +135,59 @@ static int lcd_notifier_call(struct notifier_block *this,
 	return 0;
 }
 
-static void cpufreq_sched_try_driver_target(struct cpufreq_policy *policy, unsigned int freq)
+/*
+ * Pick the frequency and relation to hand to the driver for a request of
+ * @freq, capping it while the display is off.
+ */
+static unsigned int cpufreq_sched_target_freq(struct gov_data *gd,
+		unsigned int freq, unsigned int *relation)
 {
-	struct gov_data *gd;
-	unsigned int throttle_time;
+	*relation = CPUFREQ_RELATION_L;
 
-	/* avoid race with cpufreq_sched_stop */
-	if (!down_write_trylock(&policy->rwsem))
-		return;
+	if (!display_online && freq > gd->screen_off_max_freq)
+		return gd->screen_off_max_freq;
 
-	gd = policy->governor_data;
+	if (display_online && freq > gd->prev_freq)
+		*relation = CPUFREQ_RELATION_H;
+
+	return freq;
+}
+
+static void cpufreq_sched_update_throttle(struct gov_data *gd, unsigned int freq)
+{
+	unsigned int throttle_time;
 
-	if (!gd)
-		return;
-	
-	if (!display_online && freq > screen_off_max_freq) 
-		__cpufreq_driver_target(policy, screen_off_max_freq, CPUFREQ_RELATION_L);
-	else if (display_online && freq > previous_freq) 
-		__cpufreq_driver_target(policy, freq, CPUFREQ_RELATION_H);
-	else 
-		__cpufreq_driver_target(policy, freq, CPUFREQ_RELATION_L);
-	
-	
 	if (display_online)
-		if (previous_freq > freq) 
+		if (gd->prev_freq > freq) 
 			throttle_time = gd->throttle_nsec_down;
 		else
 			throttle_time = gd->throttle_nsec_up;
 	else 
-		throttle_time = gd-> throttle_nsec_sleep;
+		throttle_time = gd->throttle_nsec_sleep;
 	
 	gd->throttle = ktime_add_ns(ktime_get(), throttle_time);
 	
-	previous_freq = freq;
-	
+	gd->prev_freq = freq;
+}
+
+static void cpufreq_sched_try_driver_target(struct cpufreq_policy *policy, unsigned int freq)
+{
+	struct gov_data *gd;
+	unsigned int target, relation;
+
+	/* avoid race with cpufreq_sched_stop */
+	if (!down_write_trylock(&policy->rwsem))
+		return;
+
+	gd = policy->governor_data;
+	if (!gd)
+		goto out;
+
+	target = cpufreq_sched_target_freq(gd, freq, &relation);
+	__cpufreq_driver_target(policy, target, relation);
+	cpufreq_sched_update_throttle(gd, freq);
+
+out:
 	up_write(&policy->rwsem);
 }
 
@@ -134,7 +203,8 @@ static int cpufreq_sched_thread(void *data)
 {
 	struct sched_param param;
 	int ret;
-	struct gov_data *gd;
+	struct gov_data *gd = data;
+	struct cpufreq_policy *policy = gd->policy;
 	
 	param.sched_priority = sched_priority;
 	ret = sched_setscheduler_nocheck(current, SCHED_FIFO, &param);
@@ -147,39 +217,141 @@ static int cpufreq_sched_thread(void *data)
 	}
 
 	/* main loop of the frequency change kthread */
-	do {
-		struct cpufreq_policy *policy = NULL;
-		unsigned int freq = 0;
-		struct gov_data *gd = NULL;
-		mutex_lock(&gov_list_lock);
-		list_for_each_entry(gd, &sched_gov_list, gov_list) {
-			if (gd->change_pending) {
-				gd->change_pending = false;	
-				freq = gd->freq;
-				policy = gd->policy;
-				break;
-			}
-		}
-		mutex_unlock(&gov_list_lock);
+	while (1) {
+		unsigned int freq;
+
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
 
-		if (!policy) {
-			set_current_state(TASK_INTERRUPTIBLE);
+		if (!ACCESS_ONCE(gd->change_pending)) {
 			schedule();
-		} else {
-			cpufreq_sched_try_driver_target(policy, freq);
+			continue;
 		}
+		__set_current_state(TASK_RUNNING);
 
-		if (kthread_should_stop())
-			break;
+		gd->change_pending = false;
+		/* pairs with smp_wmb() in cpufreq_sched_set_cap() */
+		smp_rmb();
+		freq = ACCESS_ONCE(gd->freq);
 
-	} while (!kthread_should_stop());
+		cpufreq_sched_try_driver_target(policy, freq);
+	}
+	__set_current_state(TASK_RUNNING);
 
-	do_exit(0);
+	return 0;
 }
 
 static void cpufreq_sched_irq_work(struct irq_work *irq_work)
 {
-	wake_up_process(freq_change_task);
+	struct gov_data *gd = container_of(irq_work, struct gov_data, irq_work);
+
+	wake_up_process(gd->task);
+}
+
+static void cpufreq_sched_push_window(struct cpu_demand *d, u64 window)
+{
+	d->hist_idx = (d->hist_idx + 1) % DEMAND_HIST_SIZE;
+	d->hist[d->hist_idx] = div64_u64(d->window_sum, window);
+	d->window_sum = 0;
+}
+
+/*
+ * Account the capacity requested since the last update to the current window,
+ * closing as many windows as have elapsed, and start requesting @capacity.
+ */
+static void cpufreq_sched_update_demand(int cpu, unsigned long capacity)
+{
+	struct cpu_demand *d = &per_cpu(pcpu_demand, cpu);
+	u64 window = ACCESS_ONCE(d->window);
+	u64 now = ktime_to_ns(ktime_get());
+	unsigned int nr = 0;
+
+	if (unlikely(!d->window_start || now < d->last_update)) {
+		d->window_start = d->last_update = now;
+		goto out;
+	}
+
+	while (now >= d->window_start + window) {
+		u64 end = d->window_start + window;
+
+		d->window_sum += (end - d->last_update) * d->cur_cap;
+		cpufreq_sched_push_window(d, window);
+		d->window_start = d->last_update = end;
+
+		/* the whole history has been overwritten, skip ahead */
+		if (++nr >= DEMAND_HIST_SIZE) {
+			d->window_start += div64_u64(now - d->window_start,
+						     window) * window;
+			d->last_update = d->window_start;
+			break;
+		}
+	}
+
+	d->window_sum += (now - d->last_update) * d->cur_cap;
+	d->last_update = now;
+out:
+	d->cur_cap = capacity;
+}
+
+static unsigned long cpufreq_sched_predict(struct gov_data *gd, int cpu,
+					   u64 now)
+{
+	struct cpu_demand *d = &per_cpu(pcpu_demand, cpu);
+	unsigned int idx = ACCESS_ONCE(d->hist_idx);
+	u64 window_start = ACCESS_ONCE(d->window_start);
+	unsigned int window = ACCESS_ONCE(d->window);
+	unsigned long cur_cap = ACCESS_ONCE(d->cur_cap);
+	unsigned long pred = 0, sum = 0, weight = 0;
+	unsigned int stale = 0;
+	int i;
+
+	/*
+	 * An idle or nohz cpu only closes its windows on its next request.
+	 * Windows that ended since then ran at its last request, which is
+	 * zero once it went idle, so don't let its old busy windows linger.
+	 */
+	if (window && window_start && now > window_start)
+		stale = min_t(u64, div64_u64(now - window_start, window),
+			      DEMAND_HIST_SIZE);
+
+	for (i = 0; i < DEMAND_HIST_SIZE; i++) {
+		unsigned long val;
+
+		if (i < stale) {
+			val = cur_cap;
+		} else {
+			val = ACCESS_ONCE(d->hist[idx]);
+			idx = idx ? idx - 1 : DEMAND_HIST_SIZE - 1;
+		}
+
+		switch (gd->demand_policy) {
+		case DEMAND_POLICY_MAX:
+			pred = max(pred, val);
+			break;
+		case DEMAND_POLICY_AVG:
+			sum += val;
+			weight++;
+			break;
+		case DEMAND_POLICY_RECENT:
+			/* newest window weighs DEMAND_HIST_SIZE, oldest 1 */
+			sum += val * (DEMAND_HIST_SIZE - i);
+			weight += DEMAND_HIST_SIZE - i;
+			break;
+		default:
+			return 0;
+		}
+	}
+
+	return weight ? sum / weight : pred;
+}
+
+/* capacity to provision for @cpu: its current request or predicted demand */
+static unsigned long cpufreq_sched_demand(struct gov_data *gd, int cpu,
+					  u64 now)
+{
+	return max(per_cpu(pcpu_capacity, cpu),
+		   cpufreq_sched_predict(gd, cpu, now));
 }
 
 /**
@@ -193,8 +365,15 @@ static void cpufreq_sched_irq_work(struct irq_work *irq_work)
  * designed around PELT values in CFS. It can be expanded to other scheduling
  * classes in the future if needed.
  *
- * cpufreq_sched_set_capacity raises an IPI. The irq_work handler for that IPI
- * wakes up the thread that does the actual work, cpufreq_sched_thread.
+ * If the driver can switch frequency without sleeping the new frequency is
+ * set right here. Otherwise cpufreq_sched_set_capacity raises an IPI. The
+ * irq_work handler for that IPI wakes up the per-policy thread that does the
+ * actual work, cpufreq_sched_thread.
+ *
+ * Each request is also accounted to a per-cpu history of fixed windows. Unless
+ * the policy's demand_policy is "none", the capacity provisioned for a cpu is
+ * the larger of its current request and the demand predicted from that
+ * history, so periodic loads find the right OPP before they ramp up again.
  *
  * This functions bails out early if either condition is true:
  * 1) this cpu did not the new maximum capacity for its frequency domain
@@ -207,12 +386,17 @@ void cpufreq_sched_set_cap(int cpu, unsigned long capacity)
 	struct cpufreq_policy *policy;
 	struct gov_data *gd;
 	unsigned long capacity_max = 0;
+	ktime_t now;
 
 	if (!per_cpu(governor_started, cpu))
 		return;
 
+	/* honour the util.min/util.max of the tasks RUNNABLE on this cpu */
+	capacity = schedtune_cpu_util_clamp(cpu, capacity);
+
 	/* update per-cpu capacity request */
 	per_cpu(pcpu_capacity, cpu) = capacity;
+	cpufreq_sched_update_demand(cpu, capacity);
 
 	policy = cpufreq_cpu_get(cpu);
 	if (IS_ERR_OR_NULL(policy)) {
@@ -225,12 +409,16 @@ void cpufreq_sched_set_cap(int cpu, unsigned long capacity)
 	gd = policy->governor_data;
 
 	/* bail early if we are throttled */
-	if (ktime_compare(ktime_get(), gd->throttle) < 0)
+	now = ktime_get();
+	if (ktime_compare(now, gd->throttle) < 0)
 		goto out;
 
-	/* find max capacity requested by cpus in this policy */
+	/* find max capacity demanded by cpus in this policy */
+	capacity = cpufreq_sched_demand(gd, cpu, ktime_to_ns(now));
 	for_each_cpu(cpu_tmp, policy->cpus)
-		capacity_max = max(capacity_max, per_cpu(pcpu_capacity, cpu_tmp));
+		capacity_max = max(capacity_max,
+				   cpufreq_sched_demand(gd, cpu_tmp,
+							ktime_to_ns(now)));
 
 	/*
 	 * We only change frequency if this cpu's capacity request represents a
@@ -257,11 +445,23 @@ void cpufreq_sched_set_cap(int cpu, unsigned long capacity)
 	if (freq_new == policy->cur)
 		goto out;
 
+	if (policy->fast_switch_enabled) {
+		unsigned int relation;
+
+		gd->freq = freq_new;
+		if (cpufreq_driver_fast_switch(policy,
+				cpufreq_sched_target_freq(gd, freq_new, &relation)))
+			cpufreq_sched_update_throttle(gd, freq_new);
+		goto out;
+	}
+
 	/* store the new frequency and perform the transition */
 	gd->freq = freq_new;
+	/* pairs with smp_rmb() in cpufreq_sched_thread() */
+	smp_wmb();
 	gd->change_pending = true;
 
-	irq_work_queue(&irq_work);
+	irq_work_queue(&gd->irq_work);
 
 out:
 	cpufreq_cpu_put(policy);
@@ -278,6 +478,9 @@ out:
 void cpufreq_sched_reset_cap(int cpu)
 {
 	per_cpu(pcpu_capacity, cpu) = 0;
+
+	if (per_cpu(governor_started, cpu))
+		cpufreq_sched_update_demand(cpu, 0);
 }
 
 static inline void set_sched_energy_freq(void)
@@ -296,14 +499,20 @@ static inline void clear_sched_energy_freq(void)
 
 static int cpufreq_sched_policy_start(struct cpufreq_policy *policy)
 {
+	struct gov_data *gd = policy->governor_data;
 	int cpu;
 
 	/* initialize per-cpu data */
 	for_each_cpu(cpu, policy->cpus) {
 		pr_info("%s: start CPU%d\n", __func__, cpu);
 		per_cpu(pcpu_capacity, cpu) = 0;
+		memset(&per_cpu(pcpu_demand, cpu), 0, sizeof(struct cpu_demand));
+		per_cpu(pcpu_demand, cpu).window = gd->demand_window_nsec;
 		per_cpu(pcpu_policy, cpu) = policy;
 	}
+
+	cpufreq_enable_fast_switch(policy);
+
 	return 0;
 }
 
@@ -316,6 +525,9 @@ static int cpufreq_sched_policy_stop(struct cpufreq_policy *policy)
 	for_each_cpu(cpu, policy->cpus) {
 		pr_info("%s: stop CPU%d\n", __func__, cpu);
 	}
+
+	cpufreq_disable_fast_switch(policy);
+
 	/*
 	 * Nothing to do. The per_cpu fields will be re-initialized
 	 * on the next START
@@ -379,12 +591,23 @@ static int cpufreq_sched_policy_init(struct cpufreq_policy *policy)
 	pr_debug("%s: throttle sleep threshold = %u [ns]\n",
 		  __func__, gd->throttle_nsec_sleep);
 	
-	policy->governor_data = gd;
+	gd->screen_off_max_freq = SCREEN_OFF_MAX_FREQ;
+	gd->demand_policy = DEMAND_POLICY_RECENT;
+	gd->demand_window_nsec = DEMAND_WINDOW_NSEC;
+	gd->prev_freq = policy->cur;
 	gd->policy = policy;
+	init_irq_work(&gd->irq_work, cpufreq_sched_irq_work);
+
+	gd->task = kthread_create(cpufreq_sched_thread, gd, "kpdesiresched/%d",
+				  cpumask_first(policy->related_cpus));
+	if (IS_ERR_OR_NULL(gd->task)) {
+		pr_err("%s: failed to create kpdesiresched thread\n", __func__);
+		sysfs_remove_group(get_governor_parent_kobj(policy), get_sysfs_attr());
+		goto err;
+	}
+	wake_up_process(gd->task);
 
-	mutex_lock(&gov_list_lock);
-	list_add_tail(&gd->gov_list, &sched_gov_list);
-	mutex_unlock(&gov_list_lock);
+	policy->governor_data = gd;
 
 	set_sched_energy_freq();
 
@@ -411,9 +634,11 @@ static int cpufreq_sched_policy_exit(struct cpufreq_policy *policy)
 	clear_sched_energy_freq();
 
 	policy->governor_data = NULL;
-	mutex_lock(&gov_list_lock);
-	list_del(&gd->gov_list);
-	mutex_unlock(&gov_list_lock);
+
+	/* let cpufreq_sched_set_cap() callers on other cpus drain */
+	synchronize_sched();
+	irq_work_sync(&gd->irq_work);
+	kthread_stop(gd->task);
 
 	sysfs_remove_group(get_governor_parent_kobj(policy), get_sysfs_attr());
 	
@@ -437,7 +662,6 @@ static int cpufreq_sched_setup(struct cpufreq_policy *policy, unsigned int event
 		case CPUFREQ_GOV_POLICY_EXIT:
 			return cpufreq_sched_policy_exit(policy);
 		case CPUFREQ_GOV_LIMITS:
-			mutex_lock(&gov_list_lock);
 			pr_debug("limit event for cpu %u: %u - %u kHz, currently %u kHz\n",
 				policy->cpu, policy->min, policy->max,
 				policy->cur);
@@ -446,8 +670,6 @@ static int cpufreq_sched_setup(struct cpufreq_policy *policy, unsigned int event
 			
 			if (policy->cur != clamp_freq)	
 				__cpufreq_driver_target(policy, clamp_freq, CPUFREQ_RELATION_L);
-			
-			mutex_unlock(&gov_list_lock);
 			break;
 	}
 	return 0;
@@ -528,7 +750,7 @@ static ssize_t store_sched_priority(struct gov_data *gd,
 
 static ssize_t show_screen_off_max_freq(struct gov_data *gd, char *buf)
 {
-	return sprintf(buf, "%u\n", screen_off_max_freq);
+	return sprintf(buf, "%u\n", gd->screen_off_max_freq);
 }
 
 static ssize_t store_screen_off_max_freq(struct gov_data *gd,
@@ -540,10 +762,59 @@ static ssize_t store_screen_off_max_freq(struct gov_data *gd,
 	ret = kstrtoul(buf, 0, &val);
 	if (ret < 0)
 		return ret;
-	screen_off_max_freq = val;
+	gd->screen_off_max_freq = val;
 	return count;
 }
- 
+
+static ssize_t show_demand_window_ns(struct gov_data *gd, char *buf)
+{
+	return sprintf(buf, "%u\n", gd->demand_window_nsec);
+}
+
+static ssize_t store_demand_window_ns(struct gov_data *gd,
+		const char *buf, size_t count)
+{
+	int cpu, ret;
+	long unsigned int val;
+
+	ret = kstrtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val < NSEC_PER_MSEC || val > NSEC_PER_SEC)
+		return -EINVAL;
+	gd->demand_window_nsec = val;
+	/* each cpu of the policy uses it from its next update on */
+	for_each_cpu(cpu, gd->policy->cpus)
+		ACCESS_ONCE(per_cpu(pcpu_demand, cpu).window) = val;
+	return count;
+}
+
+static ssize_t show_demand_policy(struct gov_data *gd, char *buf)
+{
+	ssize_t len = 0;
+	int i;
+
+	for (i = 0; i < DEMAND_POLICY_NR; i++)
+		len += sprintf(buf + len, i == gd->demand_policy ? "[%s] " : "%s ",
+			       demand_policy_names[i]);
+	buf[len - 1] = '\n';
+	return len;
+}
+
+static ssize_t store_demand_policy(struct gov_data *gd,
+		const char *buf, size_t count)
+{
+	int i;
+
+	for (i = 0; i < DEMAND_POLICY_NR; i++) {
+		if (sysfs_streq(buf, demand_policy_names[i])) {
+			gd->demand_policy = i;
+			return count;
+		}
+	}
+	return -EINVAL;
+}
+
 /*
  * Create show/store routines
  * - sys: One governor instance for complete SYSTEM
@@ -580,6 +851,8 @@ tunable_handlers(throttle_ns_down);
 tunable_handlers(throttle_ns_sleep);
 tunable_handlers(sched_priority);
 tunable_handlers(screen_off_max_freq);
+tunable_handlers(demand_window_ns);
+tunable_handlers(demand_policy);
 
 /* Per policy governor instance */
 static struct attribute *sched_attributes_gov_pol[] = {
@@ -588,6 +861,8 @@ static struct attribute *sched_attributes_gov_pol[] = {
 	&throttle_ns_sleep_gov_pol.attr,
 	&sched_priority_gov_pol.attr,
 	&screen_off_max_freq_gov_pol.attr,
+	&demand_window_ns_gov_pol.attr,
+	&demand_policy_gov_pol.attr,
 	NULL,
 };
 
@@ -615,19 +890,11 @@ static int __init cpufreq_sched_init(void)
 	for_each_cpu(cpu, cpu_possible_mask) {
 		per_cpu(governor_started, cpu) = 0;
 	}
-	mutex_init(&gov_list_lock);
-	freq_change_task = kthread_run(cpufreq_sched_thread, NULL, "kcpufreq_sched_task");
-	if (IS_ERR_OR_NULL(freq_change_task)) {
-			pr_err("%s: failed to create kcpufreq_sched_task thread\n", __func__);
-		return -ENOMEM;
-	}
-	init_irq_work(&irq_work, cpufreq_sched_irq_work);
 	return cpufreq_register_governor(&cpufreq_gov_sched);
 }
 
 static void __exit cpufreq_sched_exit(void)
 {
-	kthread_stop(freq_change_task);
 	cpufreq_unregister_governor(&cpufreq_gov_sched);
 }
 
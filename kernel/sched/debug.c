@@ -326,6 +326,11 @@ do {									\
 	P(ttwu_count);
 	P(ttwu_local);
 
+	P(eas_wakeups);
+	P(eas_prev_cpu_fast);
+	P(eas_nrg_calc);
+	P(eas_nrg_cache_hit);
+
 #undef P
 #undef P64
 #endif
@@ -20,13 +20,18 @@
 
 #define DEBUG
 
+#include <linux/debugfs.h>
 #include <linux/gfp.h>
+#include <linux/init.h>
 #include <linux/of.h>
 #include <linux/printk.h>
 #include <linux/sched.h>
 #include <linux/sched_energy.h>
+#include <linux/seq_file.h>
 #include <linux/stddef.h>
 
+#include "sched.h"
+
 struct sched_group_energy *sge_array[NR_CPUS][NR_SD_LEVELS];
 
 static void free_resources(void)
@@ -42,6 +47,7 @@ static void free_resources(void)
 				kfree(sge->idle_states);
 				kfree(sge);
 			}
+			sge_array[cpu][sd_level] = NULL;
 		}
 	}
 }
@@ -56,16 +62,21 @@ void init_sched_energy_costs(void)
 	int sd_level, i, nstates, cpu;
 	const __be32 *val;
 
+	/*
+	 * A model covering only some of the CPUs would make every energy
+	 * comparison involving the others meaningless, so any missing or
+	 * malformed data discards the whole model.
+	 */
 	for_each_possible_cpu(cpu) {
 		cn = of_get_cpu_node(cpu, NULL);
 		if (!cn) {
 			pr_warn("CPU device node missing for CPU %d\n", cpu);
-			return;
+			goto out;
 		}
 
 		if (!of_find_property(cn, "sched-energy-costs", NULL)) {
 			pr_warn("CPU device node has no sched-energy-costs\n");
-			return;
+			goto out;
 		}
 
 		for_each_possible_sd_level(sd_level) {
@@ -79,13 +90,23 @@ void init_sched_energy_costs(void)
 				goto out;
 			}
 
+			nstates = (prop->length / sizeof(u32)) / 2;
+			if (!nstates) {
+				pr_warn("Empty busy-cost data, skipping sched_energy init\n");
+				goto out;
+			}
+
 			sge = kcalloc(1, sizeof(struct sched_group_energy),
 				      GFP_NOWAIT);
+			if (!sge)
+				goto nomem;
+			sge_array[cpu][sd_level] = sge;
 
-			nstates = (prop->length / sizeof(u32)) / 2;
 			cap_states = kcalloc(nstates,
 					     sizeof(struct capacity_state),
 					     GFP_NOWAIT);
+			if (!cap_states)
+				goto nomem;
 
 			for (i = 0, val = prop->value; i < nstates; i++) {
 				cap_states[i].cap = be32_to_cpup(val++);
@@ -102,23 +123,136 @@ void init_sched_energy_costs(void)
 			}
 
 			nstates = (prop->length / sizeof(u32));
+			if (!nstates) {
+				pr_warn("Empty idle-cost data, skipping sched_energy init\n");
+				goto out;
+			}
+
 			idle_states = kcalloc(nstates,
 					      sizeof(struct idle_state),
 					      GFP_NOWAIT);
+			if (!idle_states)
+				goto nomem;
 
 			for (i = 0, val = prop->value; i < nstates; i++)
 				idle_states[i].power = be32_to_cpup(val++);
 
 			sge->nr_idle_states = nstates;
 			sge->idle_states = idle_states;
-
-			sge_array[cpu][sd_level] = sge;
 		}
 	}
 
 	pr_info("Sched-energy-costs installed from DT\n");
 	return;
 
+nomem:
+	pr_warn("Failed to allocate sched_energy data\n");
 out:
 	free_resources();
 }
+
+#ifdef CONFIG_TASK_ENERGY_ACCT
+/*
+ * Busy power of the capacity state each cpu was last seen running at. Only
+ * touched by the owning cpu under its rq->lock, so the cap_states walk is
+ * only repeated when the cpu changes OPP.
+ */
+struct energy_acct_state {
+	unsigned long cap;
+	unsigned long power;
+};
+
+static DEFINE_PER_CPU(struct energy_acct_state, energy_acct_state);
+
+static unsigned long busy_power_of(int cpu)
+{
+	struct energy_acct_state *st = &per_cpu(energy_acct_state, cpu);
+	struct sched_group_energy *sge = sge_array[cpu][SD_LEVEL0];
+	unsigned long cap = capacity_curr_of(cpu);
+	int i;
+
+	if (!sge)
+		return 0;
+
+	if (st->cap != cap) {
+		/* lowest capacity state able to deliver the current capacity */
+		for (i = 0; i < sge->nr_cap_states - 1; i++)
+			if (sge->cap_states[i].cap >= cap)
+				break;
+
+		st->cap = cap;
+		st->power = sge->cap_states[i].power;
+	}
+
+	return st->power;
+}
+
+/*
+ * Charge the busy energy of delta_exec ns run by p on its cpu. The model
+ * costs are normalized, not physical, so the charge is busy cost * usec;
+ * it only reads as nJ on a platform whose DT costs happen to be in mW.
+ *
+ * Called from the update_curr() of each class with rq->lock held.
+ */
+void account_task_energy(struct task_struct *p, u64 delta_exec)
+{
+	unsigned long power = busy_power_of(task_cpu(p));
+	u64 energy;
+
+	if (!power)
+		return;
+
+	energy = div_u64(delta_exec * power, 1000);
+	p->energy += energy;
+	cpuacct_charge_energy(p, energy);
+}
+#endif /* CONFIG_TASK_ENERGY_ACCT */
+
+#ifdef CONFIG_DEBUG_FS
+static int sched_energy_model_show(struct seq_file *m, void *v)
+{
+	struct sched_group_energy *sge;
+	int cpu, sd_level, i;
+
+	for_each_possible_cpu(cpu) {
+		for_each_possible_sd_level(sd_level) {
+			sge = sge_array[cpu][sd_level];
+			if (!sge)
+				break;
+
+			seq_printf(m, "cpu%d sd%d\n  cap_states (cap:power):", cpu,
+				   sd_level);
+			for (i = 0; i < sge->nr_cap_states; i++)
+				seq_printf(m, " %lu:%lu", sge->cap_states[i].cap,
+					   sge->cap_states[i].power);
+
+			seq_puts(m, "\n  idle_states (power):");
+			for (i = 0; i < sge->nr_idle_states; i++)
+				seq_printf(m, " %lu", sge->idle_states[i].power);
+			seq_putc(m, '\n');
+		}
+	}
+
+	return 0;
+}
+
+static int sched_energy_model_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, sched_energy_model_show, NULL);
+}
+
+static const struct file_operations sched_energy_model_fops = {
+	.open		= sched_energy_model_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init sched_energy_debugfs_init(void)
+{
+	debugfs_create_file("sched_energy_model", 0444, NULL, NULL,
+			    &sched_energy_model_fops);
+	return 0;
+}
+late_initcall(sched_energy_debugfs_init);
+#endif /* CONFIG_DEBUG_FS */
@@ -742,6 +742,7 @@ static void update_curr(struct cfs_rq *cfs_rq)
 
 		trace_sched_stat_runtime(curtask, delta_exec, curr->vruntime);
 		cpuacct_charge(curtask, delta_exec);
+		account_task_energy(curtask, delta_exec);
 		account_group_exec_runtime(curtask, delta_exec);
 	}
 
@@ -4026,6 +4027,29 @@ static inline void hrtick_update(struct rq *rq)
 
 unsigned int __read_mostly sysctl_sched_capacity_margin = 1280; /* ~20% margin */
 
+/*
+ * Frame-critical tasks, see sched_set_frame_hint(), get their utilization
+ * raised by this percentage of their spare capacity until their deadline.
+ */
+unsigned int __read_mostly sysctl_sched_frame_boost = 50;
+
+static inline bool task_frame_critical(struct task_struct *p)
+{
+	u64 deadline = ACCESS_ONCE(p->frame_deadline);
+
+	return deadline && local_clock() < deadline;
+}
+
+/* Utilization added to a frame-critical task, 0 for any other task */
+static inline unsigned long frame_boost_margin(struct task_struct *p,
+					       unsigned long utilization)
+{
+	if (!task_frame_critical(p) || utilization >= SCHED_LOAD_SCALE)
+		return 0;
+
+	return (SCHED_LOAD_SCALE - utilization) * sysctl_sched_frame_boost / 100;
+}
+
 static bool cpu_overutilized(int cpu);
 static unsigned long get_cpu_usage(int cpu);
 static inline unsigned long get_boosted_cpu_usage(int cpu);
@@ -4097,6 +4121,9 @@ enqueue_task_fair(struct rq *rq, struct task_struct *p, int flags)
 			unsigned long req_cap =
 				get_boosted_cpu_usage(cpu_of(rq));
 
+			/* Frame-critical tasks ramp the OPP up right away */
+			req_cap += frame_boost_margin(p, task_utilization(p));
+
 			req_cap = req_cap * sysctl_sched_capacity_margin
 					>> SCHED_CAPACITY_SHIFT;
 			cpufreq_sched_set_cap(cpu_of(rq), req_cap);
@@ -4575,12 +4602,13 @@ static int find_new_capacity(struct energy_env *eenv,
 
 	for (idx = 0; idx < sge->nr_cap_states; idx++) {
 		if (sge->cap_states[idx].cap >= util)
-			return idx;
+			break;
 	}
 
-	eenv->cap_idx = idx;
+	/* group_norm_usage() sizes the busy ratio on this capacity state */
+	eenv->cap_idx = min(idx, sge->nr_cap_states - 1);
 
-	return idx;
+	return eenv->cap_idx;
 }
 
 static bool cpu_overutilized(int cpu)
@@ -4623,6 +4651,8 @@ static unsigned int sched_group_energy(struct energy_env *eenv)
 
 	WARN_ON(!eenv->sg_top->sge);
 
+	schedstat_inc(this_rq(), eas_nrg_calc);
+
 	cpumask_copy(&visit_cpus, sched_group_cpus(eenv->sg_top));
 
 	while (!cpumask_empty(&visit_cpus)) {
@@ -4706,6 +4736,110 @@ next_cpu:
 	return total_energy;
 }
 
+/*
+ * Energy cache
+ * The energy of a sched group before a task is placed only depends on the
+ * usage and idle state of its cpus (and on which of them is src_cpu, for the
+ * capacity bookkeeping). Wake-ups in a row mostly see the same values for the
+ * groups they do not touch, so the last few results are kept per cpu and
+ * reused as long as none of those inputs changed. The cache is only used with
+ * interrupts disabled, from the wake-up path.
+ *
+ * Capacity states are assumed not to be shared beyond the top energy aware
+ * sched group, which holds for the MC/DIE topologies using energy data.
+ */
+#define ENERGY_CACHE_ENTRIES	4
+#define ENERGY_CACHE_MAX_CPUS	8
+
+struct energy_cache_entry {
+	struct sched_group		*sg;
+	struct sched_group_energy	*sge;
+	unsigned int			weight;
+	int				src_cpu;
+	int				energy;
+	int				cap_before;
+	int				cap_delta;
+	unsigned long			usage[ENERGY_CACHE_MAX_CPUS];
+	int				idle_idx[ENERGY_CACHE_MAX_CPUS];
+};
+
+struct energy_cache {
+	struct energy_cache_entry	entry[ENERGY_CACHE_ENTRIES];
+	unsigned int			next;
+};
+
+static DEFINE_PER_CPU(struct energy_cache, energy_cache);
+
+static bool energy_cache_match(struct energy_cache_entry *ce,
+			       struct energy_env *eenv)
+{
+	struct sched_group *sg = eenv->sg_top;
+	int i, n = 0;
+
+	if (ce->sg != sg || ce->sge != sg->sge ||
+	    ce->weight != sg->group_weight || ce->src_cpu != eenv->src_cpu)
+		return false;
+
+	for_each_cpu(i, sched_group_cpus(sg)) {
+		if (ce->usage[n] != get_cpu_usage(i) ||
+		    ce->idle_idx[n] != idle_get_state_idx(cpu_rq(i)))
+			return false;
+		n++;
+	}
+
+	return true;
+}
+
+/*
+ * sched_group_energy_cached(): sched_group_energy() for an energy_env which
+ * does not move any utilization, served from the energy cache if possible.
+ */
+static unsigned int sched_group_energy_cached(struct energy_env *eenv)
+{
+	struct energy_cache *ec = this_cpu_ptr(&energy_cache);
+	struct sched_group *sg = eenv->sg_top;
+	struct energy_cache_entry *ce;
+	int cap_delta = eenv->cap.delta;
+	int i, n = 0;
+
+	if (WARN_ON_ONCE(eenv->usage_delta) ||
+	    sg->group_weight > ENERGY_CACHE_MAX_CPUS)
+		return sched_group_energy(eenv);
+
+	for (i = 0; i < ENERGY_CACHE_ENTRIES; i++) {
+		ce = &ec->entry[i];
+		if (!energy_cache_match(ce, eenv))
+			continue;
+
+		schedstat_inc(this_rq(), eas_nrg_cache_hit);
+		if (ce->cap_delta) {
+			eenv->cap.before = ce->cap_before;
+			eenv->cap.delta += ce->cap_delta;
+		}
+		eenv->energy = ce->energy;
+		return ce->energy;
+	}
+
+	ce = &ec->entry[ec->next];
+	ec->next = (ec->next + 1) % ENERGY_CACHE_ENTRIES;
+
+	ce->sg = sg;
+	ce->sge = sg->sge;
+	ce->weight = sg->group_weight;
+	ce->src_cpu = eenv->src_cpu;
+	for_each_cpu(i, sched_group_cpus(sg)) {
+		ce->usage[n] = get_cpu_usage(i);
+		ce->idle_idx[n] = idle_get_state_idx(cpu_rq(i));
+		n++;
+	}
+
+	ce->energy = sched_group_energy(eenv);
+	ce->cap_before = eenv->cap.before;
+	ce->cap_delta = eenv->cap.delta - cap_delta;
+
+	return ce->energy;
+}
+
 #ifdef CONFIG_SCHED_TUNE
 static int energy_diff_evaluate(struct energy_env *eenv)
 {
@@ -4786,7 +4920,7 @@ static int energy_diff(struct energy_env *eenv)
 		if (eenv->src_cpu != -1 && cpumask_test_cpu(eenv->src_cpu,
 							sched_group_cpus(sg))) {
 			eenv_before.sg_top = eenv->sg_top = sg;
-			energy_before += sched_group_energy(&eenv_before);
+			energy_before += sched_group_energy_cached(&eenv_before);
 
 			/* Keep track of SRC cpu (before) capacity */
 			eenv->cap.before = eenv_before.cap.before;
@@ -4801,7 +4935,7 @@ static int energy_diff(struct energy_env *eenv)
 		if (eenv->dst_cpu != -1	&& cpumask_test_cpu(eenv->dst_cpu,
 							sched_group_cpus(sg))) {
 			eenv_before.sg_top = eenv->sg_top = sg;
-			energy_before += sched_group_energy(&eenv_before);
+			energy_before += sched_group_energy_cached(&eenv_before);
 			energy_after += sched_group_energy(eenv);
 		}
 	} while (sg = sg->next, sg != sd->groups);
@@ -4998,8 +5132,9 @@ boosted_task_utilization(struct task_struct *task)
 	trace_sched_boost_task(task, utilization, margin);
 
 	utilization += margin;
+	utilization += frame_boost_margin(task, utilization);
 
-	return utilization;
+	return schedtune_task_util_clamp(task, utilization);
 }
 
 #else /* CONFIG_SCHED_TUNE */
@@ -5007,7 +5142,9 @@ boosted_task_utilization(struct task_struct *task)
 static unsigned long
 boosted_task_utilization(struct task_struct *task)
 {
-	return task_utilization(task);
+	unsigned long utilization = task_utilization(task);
+
+	return utilization + frame_boost_margin(task, utilization);
 }
 
 #endif /* CONFIG_SCHED_TUNE */
@@ -5196,6 +5333,9 @@ find_idlest_cpu(struct sched_group *group, struct task_struct *p, int this_cpu)
 
 	/* Traverse only the allowed CPUs */
 	for_each_cpu_and(i, sched_group_cpus(group), tsk_cpus_allowed(p)) {
+		if (cpu_isolated(i))
+			continue;
+
 		if (task_fits_cpu(p, i)) {
 			struct rq *rq = cpu_rq(i);
 			struct cpuidle_state *idle = idle_get_state(rq);
@@ -5276,6 +5416,9 @@ static int select_idle_sibling(struct task_struct *p, int target)
 				int idle_idx = idle_get_state_idx(rq);
 				unsigned long new_usage = boosted_task_utilization(p);
 				unsigned long capacity_orig = capacity_orig_of(i);
+
+				if (cpu_isolated(i))
+					continue;
 				if (new_usage > capacity_orig || !idle_cpu(i))
 					goto next;
 
@@ -5301,22 +5444,52 @@ next:
 	return target;
 }
 
+/*
+ * A task which fits its previous cpu at the current OPP, on a cpu which is
+ * not among the biggest ones, cannot be placed in a cheaper way worth the
+ * cost of scanning the groups and computing their energy.
+ */
+static bool energy_aware_prev_cpu_fits(struct task_struct *p, int cpu)
+{
+	unsigned long new_usage;
+
+	if (!cpumask_test_cpu(cpu, tsk_cpus_allowed(p)) || !cpu_online(cpu) ||
+	    cpu_isolated(cpu))
+		return false;
+
+	if (capacity_orig_of(cpu) >= cpu_rq(cpu)->rd->max_cpu_capacity)
+		return false;
+
+	new_usage = get_cpu_usage(cpu) + boosted_task_utilization(p);
+
+	return (capacity_curr_of(cpu) * 1024) >
+			(new_usage * sysctl_sched_capacity_margin);
+}
+
 static int energy_aware_wake_cpu(struct task_struct *p, int target, int sync)
 {
 	struct sched_domain *sd;
 	struct sched_group *sg, *sg_target;
 	int target_max_cap = INT_MAX;
 	int target_cpu = -1;
+	bool prefer_big = task_frame_critical(p);
 	int i;
 
-	if (sync) {
+	schedstat_inc(this_rq(), eas_wakeups);
+
+	if (sync && !prefer_big) {
 		int cpu = smp_processor_id();
 		cpumask_t search_cpus;
 		cpumask_and(&search_cpus, tsk_cpus_allowed(p), cpu_online_mask);
-		if (cpumask_test_cpu(cpu, &search_cpus))
+		if (cpumask_test_cpu(cpu, &search_cpus) && !cpu_isolated(cpu))
 			return cpu;
 	}
 
+	if (!prefer_big && energy_aware_prev_cpu_fits(p, task_cpu(p))) {
+		schedstat_inc(this_rq(), eas_prev_cpu_fast);
+		return task_cpu(p);
+	}
+
 	sd = rcu_dereference(per_cpu(sd_ea, task_cpu(p)));
 
 	if (!sd)
@@ -5349,6 +5522,22 @@ static int energy_aware_wake_cpu(struct task_struct *p, int target, int sync)
 
 	} while (sg = sg->next, sg != sd->groups);
 
+	/* Frame-critical tasks go to the biggest cpus until their deadline */
+	if (prefer_big) {
+		target_max_cap = 0;
+		sg = sd->groups;
+		do {
+			int max_cap_cpu = group_first_cpu(sg);
+
+			if (capacity_orig_of(max_cap_cpu) > target_max_cap &&
+			    cpumask_intersects(sched_group_cpus(sg),
+					       tsk_cpus_allowed(p))) {
+				sg_target = sg;
+				target_max_cap = capacity_orig_of(max_cap_cpu);
+			}
+		} while (sg = sg->next, sg != sd->groups);
+	}
+
 	/* Find cpu with sufficient capacity */
 	for_each_cpu_and(i, tsk_cpus_allowed(p), sched_group_cpus(sg_target)) {
 		/*
@@ -5358,6 +5547,9 @@ static int energy_aware_wake_cpu(struct task_struct *p, int target, int sync)
 		 */
 		int new_usage = get_cpu_usage(i) + boosted_task_utilization(p);
 
+		if (cpu_isolated(i))
+			continue;
+
 		if (new_usage >	capacity_orig_of(i))
 			continue;
 
@@ -5374,7 +5566,7 @@ static int energy_aware_wake_cpu(struct task_struct *p, int target, int sync)
 
 	if (target_cpu < 0)
 		target_cpu = task_cpu(p);
-	else if (target_cpu != task_cpu(p)) {
+	else if (target_cpu != task_cpu(p) && !prefer_big) {
 		struct energy_env eenv = {
 			.usage_delta	= task_utilization(p),
 			.src_cpu	= task_cpu(p),
@@ -5393,6 +5585,36 @@ static int energy_aware_wake_cpu(struct task_struct *p, int target, int sync)
 	return target_cpu;
 }
 
+/*
+ * Isolated cpus only take tasks that are allowed nowhere else. Move a
+ * placement that ended up on one to the closest non-isolated cpu, idle if
+ * possible, instead of leaving it to select_fallback_rq(), which would
+ * pile every such task onto the lowest allowed cpu.
+ */
+static int unisolated_cpu_near(struct task_struct *p, int cpu)
+{
+	struct sched_domain *sd;
+	int i, busy = -1;
+
+	if (!cpu_isolated(cpu))
+		return cpu;
+
+	for_each_domain(cpu, sd) {
+		for_each_cpu_and(i, sched_domain_span(sd), tsk_cpus_allowed(p)) {
+			if (cpu_isolated(i) || !cpu_active(i))
+				continue;
+			if (idle_cpu(i))
+				return i;
+			if (busy < 0)
+				busy = i;
+		}
+		if (busy >= 0)
+			return busy;
+	}
+
+	return cpu;
+}
+
 /*
  * select_task_rq_fair: Select target runqueue for the waking task in domains
  * that have the 'sd_flag' flag set. In practice, this is SD_BALANCE_WAKE,
@@ -5418,8 +5640,12 @@ select_task_rq_fair(struct task_struct *p, int prev_cpu, int sd_flag, int wake_f
 	if (p->nr_cpus_allowed == 1)
 		return prev_cpu;
 
-	/* Check if prev_cpu can fit us ignoring its current usage */
-	if (energy_aware() && !task_fits_capacity(p, prev_cpu))
+	/*
+	 * Check if prev_cpu can fit us ignoring its current usage. The energy
+	 * aware path moves frame-critical tasks to a bigger cpu by itself.
+	 */
+	if (energy_aware() && !task_fits_capacity(p, prev_cpu) &&
+	    !task_frame_critical(p))
 		want_sibling = false;
 
 	if (sd_flag & SD_BALANCE_WAKE && want_sibling)
@@ -5490,6 +5716,8 @@ select_task_rq_fair(struct task_struct *p, int prev_cpu, int sd_flag, int wake_f
 		/* while loop will break here if sd == NULL */
 	}
 unlock:
+	/* covers the sibling, energy aware and find_idlest paths alike */
+	new_cpu = unisolated_cpu_near(p, new_cpu);
 	rcu_read_unlock();
 
 	return new_cpu;
@@ -7929,7 +8157,9 @@ static int idle_balance(struct rq *this_rq)
 	 */
 	this_rq->idle_stamp = rq_clock(this_rq);
 
-	if ((!energy_aware() && (this_rq->avg_idle < sysctl_sched_migration_cost
+	/* An isolated cpu must not pull work back onto itself */
+	if (cpu_isolated(this_cpu) ||
+	    (!energy_aware() && (this_rq->avg_idle < sysctl_sched_migration_cost
 				 || !this_rq->rd->overload)) ||
 	    (energy_aware() && !this_rq->rd->overutilized)) {
 		rcu_read_lock();
@@ -8239,9 +8469,10 @@ void nohz_balance_enter_idle(int cpu)
 		return;
 
 	/*
-	 * If we're a completely isolated CPU, we don't play.
+	 * If we're a completely isolated CPU, we don't play. Neither do cpus
+	 * isolated at runtime: they must not be chosen as idle load balancer.
 	 */
-	if (on_null_domain(cpu_rq(cpu)))
+	if (on_null_domain(cpu_rq(cpu)) || cpu_isolated(cpu))
 		return;
 
 	cpumask_set_cpu(cpu, nohz.idle_cpus_mask);
@@ -8528,7 +8759,12 @@ void trigger_load_balance(struct rq *rq)
 	if (unlikely(on_null_domain(rq)))
 		return;
 
-	if (time_after_eq(jiffies, rq->next_balance))
+	/*
+	 * A runtime isolated cpu doesn't pull, but it may still kick the idle
+	 * load balancer so that others pull what is left on it.
+	 */
+	if (time_after_eq(jiffies, rq->next_balance) &&
+	    !cpu_isolated(cpu_of(rq)))
 		raise_softirq(SCHED_SOFTIRQ);
 #ifdef CONFIG_NO_HZ_COMMON
 	if (nohz_kick_needed(rq))
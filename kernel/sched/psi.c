@@ -0,0 +1,247 @@
+/*
+ * Pressure stall information for memory
+ *
+ * Tracks the time tasks spend stalled in direct reclaim, direct compaction
+ * and swap-in.  Every runqueue keeps a small state machine (SOME, FULL,
+ * NONIDLE) under rq->lock which is advanced from the memstall annotations
+ * and from enqueue/dequeue.  A deferrable worker folds the per-CPU times
+ * every two seconds into 10s, 60s and 300s running averages, weighting
+ * each CPU by its non-idle time so that idle CPUs do not dilute a stall.
+ *
+ * A stalled task is charged to the CPU it entered the stall on, even if
+ * it later migrates; FULL on that CPU then means no runnable task there is
+ * doing anything but stalling.  This is coarser than tracking the task
+ * across migrations but needs no hooks outside enqueue/dequeue.
+ *
+ * The averages are exported in /proc/pressure/memory:
+ *
+ *   some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ *   full avg10=0.00 avg60=0.00 avg300=0.00 total=0
+ *
+ * where avgN is the percentage of time stalled and total is in usecs.
+ */
+
+#include <linux/psi.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/workqueue.h>
+
+#include "sched.h"
+
+#define PSI_FREQ	(2 * HZ + 1)	/* 2 sec intervals */
+#define EXP_10s		1677		/* 1/exp(2s/10s) as fixed-point */
+#define EXP_60s		1981		/* 1/exp(2s/60s) */
+#define EXP_300s	2034		/* 1/exp(2s/300s) */
+
+#define LOAD_INT(x) ((x) >> FSHIFT)
+#define LOAD_FRAC(x) LOAD_INT(((x) & (FIXED_1 - 1)) * 100)
+
+static const unsigned long psi_exp[NR_PSI_AVGS] = {
+	EXP_10s, EXP_60s, EXP_300s,
+};
+
+/* Only SOME and FULL are reported, NONIDLE is the weight */
+#define NR_PSI_REPORTED	PSI_NONIDLE
+
+static DEFINE_PER_CPU(u64 [NR_PSI_STATES], psi_prev_times);
+
+static u64 psi_total[NR_PSI_REPORTED];
+static unsigned long psi_avg[NR_PSI_REPORTED][NR_PSI_AVGS];
+static u64 psi_last_update;
+
+static struct delayed_work psi_avgs_work;
+
+/*
+ * Close the current state period of @rq and switch to @state.
+ * Called with rq->lock held.
+ */
+void psi_rq_update(struct rq *rq, unsigned int state)
+{
+	u64 now = sched_clock_cpu(cpu_of(rq));
+	u64 delta = now - rq->psi_state_start;
+	int s;
+
+	for (s = 0; s < NR_PSI_STATES; s++) {
+		if (rq->psi_state & (1 << s))
+			rq->psi_times[s] += delta;
+	}
+	rq->psi_state = state;
+	rq->psi_state_start = now;
+}
+
+/**
+ * psi_memstall_enter - mark the beginning of a memory stall section
+ * @flags: flags to handle nested sections
+ *
+ * Marks the calling task as being stalled due to a lack of memory,
+ * such as waiting for a swap-in or performing direct reclaim.
+ */
+void psi_memstall_enter(unsigned long *flags)
+{
+	unsigned long irqflags;
+	struct rq *rq;
+
+	*flags = current->in_memstall;
+	if (*flags)
+		return;
+
+	local_irq_save(irqflags);
+	rq = this_rq();
+	raw_spin_lock(&rq->lock);
+	current->in_memstall = 1;
+	current->memstall_cpu = cpu_of(rq);
+	rq->psi_nr_memstall++;
+	rq->psi_nr_memstall_running++;
+	psi_rq_change(rq);
+	raw_spin_unlock(&rq->lock);
+	local_irq_restore(irqflags);
+}
+
+/**
+ * psi_memstall_leave - mark the end of a memory stall section
+ * @flags: flags to handle nested sections
+ */
+void psi_memstall_leave(unsigned long *flags)
+{
+	unsigned long irqflags;
+	struct rq *rq;
+	int cpu;
+
+	if (*flags)
+		return;
+
+	local_irq_save(irqflags);
+	rq = this_rq();
+	raw_spin_lock(&rq->lock);
+	current->in_memstall = 0;
+	rq->psi_nr_memstall_running--;
+	cpu = current->memstall_cpu;
+	if (cpu != cpu_of(rq)) {
+		psi_rq_change(rq);
+		raw_spin_unlock(&rq->lock);
+		rq = cpu_rq(cpu);
+		raw_spin_lock(&rq->lock);
+	}
+	rq->psi_nr_memstall--;
+	psi_rq_change(rq);
+	raw_spin_unlock(&rq->lock);
+	local_irq_restore(irqflags);
+}
+
+/**
+ * psi_mem_pressure - current memory stall percentage
+ * @state: PSI_MEM_SOME or PSI_MEM_FULL
+ * @window: averaging window
+ */
+unsigned int psi_mem_pressure(enum psi_states state, enum psi_avgs window)
+{
+	if (state >= NR_PSI_REPORTED || window >= NR_PSI_AVGS)
+		return 0;
+
+	return LOAD_INT(ACCESS_ONCE(psi_avg[state][window]));
+}
+
+static unsigned long psi_calc_avg(unsigned long avg, unsigned long exp,
+				  unsigned long sample)
+{
+	avg *= exp;
+	avg += sample * (FIXED_1 - exp);
+	avg += 1UL << (FSHIFT - 1);
+	return avg >> FSHIFT;
+}
+
+static void psi_update_avgs(struct work_struct *work)
+{
+	u64 deltas[NR_PSI_REPORTED] = { 0, };
+	u64 nonidle_total = 0;
+	u64 now, period;
+	int cpu, s, w;
+
+	for_each_possible_cpu(cpu) {
+		u64 *prev = per_cpu(psi_prev_times, cpu);
+		struct rq *rq = cpu_rq(cpu);
+		u64 times[NR_PSI_STATES];
+		u32 nonidle;
+
+		raw_spin_lock_irq(&rq->lock);
+		psi_rq_update(rq, rq->psi_state);
+		memcpy(times, rq->psi_times, sizeof(times));
+		raw_spin_unlock_irq(&rq->lock);
+
+		nonidle = nsecs_to_jiffies(times[PSI_NONIDLE] -
+					   prev[PSI_NONIDLE]);
+		for (s = 0; s < NR_PSI_REPORTED; s++)
+			deltas[s] += (times[s] - prev[s]) * nonidle;
+		nonidle_total += nonidle;
+		memcpy(prev, times, sizeof(times));
+	}
+
+	now = local_clock();
+	period = now - psi_last_update;
+	psi_last_update = now;
+
+	for (s = 0; s < NR_PSI_REPORTED; s++) {
+		unsigned long sample;
+		u64 stall = 0;
+
+		if (nonidle_total)
+			stall = div64_u64(deltas[s], nonidle_total);
+		psi_total[s] += stall;
+
+		stall = min(stall, period);
+		sample = period ?
+			div64_u64(stall * 100 * FIXED_1, period) : 0;
+		for (w = 0; w < NR_PSI_AVGS; w++)
+			psi_avg[s][w] = psi_calc_avg(psi_avg[s][w],
+						     psi_exp[w], sample);
+	}
+
+	schedule_delayed_work(&psi_avgs_work, PSI_FREQ);
+}
+
+static int psi_memory_show(struct seq_file *m, void *v)
+{
+	static const char * const names[NR_PSI_REPORTED] = {
+		"some", "full",
+	};
+	int s;
+
+	for (s = 0; s < NR_PSI_REPORTED; s++) {
+		unsigned long avg10 = psi_avg[s][PSI_AVG10];
+		unsigned long avg60 = psi_avg[s][PSI_AVG60];
+		unsigned long avg300 = psi_avg[s][PSI_AVG300];
+
+		seq_printf(m, "%s avg10=%lu.%02lu avg60=%lu.%02lu "
+			   "avg300=%lu.%02lu total=%llu\n", names[s],
+			   LOAD_INT(avg10), LOAD_FRAC(avg10),
+			   LOAD_INT(avg60), LOAD_FRAC(avg60),
+			   LOAD_INT(avg300), LOAD_FRAC(avg300),
+			   div_u64(psi_total[s], NSEC_PER_USEC));
+	}
+
+	return 0;
+}
+
+static int psi_memory_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, psi_memory_show, NULL);
+}
+
+static const struct file_operations psi_memory_fops = {
+	.open		= psi_memory_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init psi_init(void)
+{
+	psi_last_update = local_clock();
+	INIT_DEFERRABLE_WORK(&psi_avgs_work, psi_update_avgs);
+	schedule_delayed_work(&psi_avgs_work, PSI_FREQ);
+
+	proc_mkdir("pressure", NULL);
+	proc_create("pressure/memory", 0, NULL, &psi_memory_fops);
+	return 0;
+}
+__initcall(psi_init);
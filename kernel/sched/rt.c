@@ -953,6 +953,7 @@ static void update_curr_rt(struct rq *rq)
 
 	curr->se.exec_start = rq_clock_task(rq);
 	cpuacct_charge(curr, delta_exec);
+	account_task_energy(curr, delta_exec);
 
 	sched_rt_avg_update(rq, delta_exec);
 
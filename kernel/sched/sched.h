@@ -8,6 +8,7 @@
 #include <linux/stop_machine.h>
 #include <linux/tick.h>
 #include <linux/slab.h>
+#include <linux/psi.h>
 
 #include "cpupri.h"
 #include "cpudeadline.h"
@@ -665,6 +666,12 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* energy aware wake-up stats */
+	unsigned int eas_wakeups;
+	unsigned int eas_prev_cpu_fast;
+	unsigned int eas_nrg_calc;
+	unsigned int eas_nrg_cache_hit;
 #endif
 
 #ifdef CONFIG_SMP
@@ -676,6 +683,15 @@ struct rq {
 	struct cpuidle_state *idle_state;
 	int idle_state_idx;
 #endif
+
+#ifdef CONFIG_PSI
+	/* memory stalls charged to this cpu, and stalled tasks queued here */
+	unsigned int psi_nr_memstall;
+	unsigned int psi_nr_memstall_running;
+	unsigned int psi_state;
+	u64 psi_state_start;
+	u64 psi_times[NR_PSI_STATES];
+#endif
 };
 
 static inline int cpu_of(struct rq *rq)
@@ -711,7 +727,7 @@ extern int migrate_task_to(struct task_struct *p, int cpu);
 extern int migrate_swap(struct task_struct *, struct task_struct *);
 #endif /* CONFIG_NUMA_BALANCING */
 
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
 struct nr_stats_s {
 	/* time-based average load */
 	u64 nr_last_stamp;
@@ -1314,6 +1330,14 @@ unsigned long arch_scale_cpu_capacity(struct sched_domain *sd, int cpu)
 
 unsigned long capacity_orig_of(int cpu);
 
+#ifdef CONFIG_TASK_ENERGY_ACCT
+extern void account_task_energy(struct task_struct *p, u64 delta_exec);
+#else
+static inline void account_task_energy(struct task_struct *p, u64 delta_exec)
+{
+}
+#endif
+
 extern struct static_key __sched_energy_freq;
 static inline bool sched_energy_freq(void)
 {
@@ -1355,7 +1379,7 @@ extern void update_idle_cpu_load(struct rq *this_rq);
 
 extern void init_task_runnable_average(struct task_struct *p);
 
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
 static inline unsigned int do_avg_nr_running(struct rq *rq)
 {
 
@@ -1378,12 +1402,12 @@ static inline unsigned int do_avg_nr_running(struct rq *rq)
  
 static inline void add_nr_running(struct rq *rq, unsigned count)
 {
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
 	struct nr_stats_s *nr_stats = &per_cpu(runqueue_stats, rq->cpu);
 #endif
 	unsigned prev_nr = rq->nr_running;
 	
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
  	write_seqcount_begin(&nr_stats->ave_seqcnt);
  	nr_stats->ave_nr_running = do_avg_nr_running(rq);
  	nr_stats->nr_last_stamp = rq->clock_task;
@@ -1391,7 +1415,7 @@ static inline void add_nr_running(struct rq *rq, unsigned count)
 
 	rq->nr_running = prev_nr + count;
 
-#ifdef CONFIG_INTELLI_PLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
  	write_seqcount_end(&nr_stats->ave_seqcnt);
 #endif
  
@@ -1419,7 +1443,7 @@ static inline void add_nr_running(struct rq *rq, unsigned count)
 
 static inline void sub_nr_running(struct rq *rq, unsigned count)
 {
-#ifdef CONFIG_LAZYPLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
  	struct nr_stats_s *nr_stats = &per_cpu(runqueue_stats, rq->cpu);
 
 	write_seqcount_begin(&nr_stats->ave_seqcnt);
@@ -1429,7 +1453,7 @@ static inline void sub_nr_running(struct rq *rq, unsigned count)
 
 	rq->nr_running -= count;
 
-#ifdef CONFIG_INTELLI_PLUG
+#ifdef CONFIG_SCHED_AVG_NR_RUNNING
  	write_seqcount_end(&nr_stats->ave_seqcnt);
 #endif
 }
@@ -158,6 +158,50 @@ sched_info_switch(struct rq *rq,
 #define sched_info_switch(rq, t, next)		do { } while (0)
 #endif /* CONFIG_SCHEDSTATS || CONFIG_TASK_DELAY_ACCT */
 
+#ifdef CONFIG_PSI
+extern void psi_rq_update(struct rq *rq, unsigned int state);
+
+static inline unsigned int psi_rq_state(struct rq *rq)
+{
+	unsigned int state = 0;
+
+	if (rq->nr_running || rq->psi_nr_memstall)
+		state |= 1 << PSI_NONIDLE;
+	if (rq->psi_nr_memstall) {
+		state |= 1 << PSI_MEM_SOME;
+		if (rq->nr_running == rq->psi_nr_memstall_running)
+			state |= 1 << PSI_MEM_FULL;
+	}
+	return state;
+}
+
+/* Advance the pressure state of @rq, rq->lock held */
+static inline void psi_rq_change(struct rq *rq)
+{
+	unsigned int state = psi_rq_state(rq);
+
+	if (state != rq->psi_state)
+		psi_rq_update(rq, state);
+}
+
+static inline void psi_enqueue(struct rq *rq, struct task_struct *p)
+{
+	if (unlikely(p->in_memstall))
+		rq->psi_nr_memstall_running++;
+	psi_rq_change(rq);
+}
+
+static inline void psi_dequeue(struct rq *rq, struct task_struct *p)
+{
+	if (unlikely(p->in_memstall))
+		rq->psi_nr_memstall_running--;
+	psi_rq_change(rq);
+}
+#else
+#define psi_enqueue(rq, p)			do { } while (0)
+#define psi_dequeue(rq, p)			do { } while (0)
+#endif /* CONFIG_PSI */
+
 /*
  * The following are functions that support scheduler-internal time accounting.
  * These functions are generally called at the timer tick.  None of this depends
@@ -72,6 +72,7 @@ static void put_prev_task_stop(struct rq *rq, struct task_struct *prev)
 
 	curr->se.exec_start = rq_clock_task(rq);
 	cpuacct_charge(curr, delta_exec);
+	account_task_energy(curr, delta_exec);
 }
 
 static void task_tick_stop(struct rq *rq, struct task_struct *curr, int queued)
@@ -1,10 +1,15 @@
 #include <linux/cgroup.h>
 #include <linux/err.h>
+#include <linux/init.h>
 #include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/mutex.h>
 #include <linux/percpu.h>
 #include <linux/printk.h>
 #include <linux/rcupdate.h>
+#include <linux/sched_energy.h>
 #include <linux/slab.h>
+#include <linux/topology.h>
 
 #include <trace/events/sched.h>
 
@@ -56,45 +61,12 @@ struct target_nrg {
 
 /*
  * Target specific system energy normalization constants
- * NOTE: These values are specific for ARM TC2 and they are derived from the
- *       energy model data defined in: arch/arm/kernel/topology.c
+ * NOTE: These values are derived at boot from the energy model loaded from
+ *       the sched-energy-costs DT nodes, see schedtune_init_energy().
+ *       They stay zero, and energy is not normalized, without a model.
  */
 static struct target_nrg
-schedtune_target_nrg = {
-
-	/*
-	 * TC2 Min CPUs power:
-	 * all CPUs idle, all clusters in deep idle:
-	 *   0 * 3 + 0 * 2 + 10 + 25
-	 */
-	.min_power = 35,
-
-	/*
-	 * TC2 Max CPUs power:
-	 * all CPUs fully utilized while running at max OPP:
-	 *   1024 * 3 + 6997 * 2 + 4905 + 15200
-	 */
-
-	.max_power = 37171,
-
-	/*
-	 * Fast integer division by constant:
-	 *  Constant   : Max - Min       (C) = 37171 - 35 = 37136
-	 *  Precision  : 0.1%            (P) = 0.1
-	 *  Reference  : C * 100 / P     (R) = 3713600
-	 *
-	 * Thus:
-	 *  Shift bifs : ceil(log(R,2))  (S) = 26
-	 *  Mult const : round(2^S/C)    (M) = 1807
-	 *
-	 * This allows to compute the normalized energy:
-	 *   system_energy / C
-	 * as:
-	 *   (system_energy * M) >> S
-	 */
-	.nrg_shift = 26,	/* S */
-	.nrg_mult  = 1807,	/* M */
-};
+schedtune_target_nrg;
 
 /*
  * System energy normalization
@@ -107,6 +79,10 @@ schedtune_normalize_energy(int energy_diff)
 	long long normalized_nrg = energy_diff;
 	int max_delta;
 
+	/* No energy model available */
+	if (!schedtune_target_nrg.nrg_mult)
+		return energy_diff;
+
 	/* Check for boundaries */
 	max_delta  = schedtune_target_nrg.max_power;
 	max_delta -= schedtune_target_nrg.min_power;
@@ -122,6 +98,73 @@ schedtune_normalize_energy(int energy_diff)
 	return normalized_nrg;
 }
 
+/*
+ * Add the energy of the sched group energy data of a CPU, or of its cluster,
+ * to the system min and max power:
+ *  - min power: the group is in its deepest idle state
+ *  - max power: the group is fully utilized at its max OPP
+ */
+static void
+schedtune_add_group_energy(struct target_nrg *ste,
+		struct sched_group_energy *sge)
+{
+	ste->min_power += sge->idle_states[sge->nr_idle_states - 1].power;
+	ste->max_power += sge->cap_states[sge->nr_cap_states - 1].power;
+}
+
+static int __init
+schedtune_init_energy(void)
+{
+	struct target_nrg *ste = &schedtune_target_nrg;
+	struct target_nrg nrg = { 0 };
+	struct sched_group_energy *sge;
+	unsigned long delta;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		sge = sge_array[cpu][SD_LEVEL0];
+		if (!sge) {
+			pr_info("schedtune: no energy model, "
+				"energy normalization disabled\n");
+			return 0;
+		}
+		schedtune_add_group_energy(&nrg, sge);
+
+		/* Cluster energy is accounted once, on its first CPU */
+		sge = sge_array[cpu][SD_LEVEL1];
+		if (sge && cpu == cpumask_first(topology_core_cpumask(cpu)))
+			schedtune_add_group_energy(&nrg, sge);
+	}
+
+	if (nrg.max_power <= nrg.min_power) {
+		pr_warn("schedtune: invalid energy model, "
+			"energy normalization disabled\n");
+		return 0;
+	}
+
+	/*
+	 * Fast integer division by constant:
+	 *  Constant   : Max - Min       (C)
+	 *  Precision  : 0.1%            (P) = 0.1
+	 *  Reference  : C * 100 / P     (R) = C * 1000
+	 *
+	 * Thus:
+	 *  Shift bifs : ceil(log(R,2))  (S)
+	 *  Mult const : round(2^S/C)    (M)
+	 */
+	delta = nrg.max_power - nrg.min_power;
+	nrg.nrg_shift = order_base_2(delta * 1000);
+	nrg.nrg_mult = DIV_ROUND_CLOSEST(1ULL << nrg.nrg_shift, delta);
+
+	*ste = nrg;
+	pr_info("schedtune: energy normalization min_power=%lu max_power=%lu "
+		"shift=%lu mult=%lu\n", ste->min_power, ste->max_power,
+		ste->nrg_shift, ste->nrg_mult);
+
+	return 0;
+}
+late_initcall(schedtune_init_energy);
+
 static int
 __schedtune_accept_deltas(int nrg_delta, int cap_delta,
 		int perf_boost_idx, int perf_constrain_idx) {
@@ -175,6 +218,32 @@ __schedtune_accept_deltas(int nrg_delta, int cap_delta,
  * EAS scheduler tunables for task groups.
  */
 
+/*
+ * Utilization clamps
+ * Each boost group can restrict the utilization of its tasks to the range
+ * [util.min..util.max], in capacity units. A CPU is clamped to the maximum
+ * util.min and to the maximum util.max of the boost groups which currently
+ * have RUNNABLE tasks on it. Clamp values are refcounted per CPU in a small
+ * number of buckets, so that the maximum is found with a single bit scan.
+ */
+#define UTIL_CLAMP_BUCKETS	20
+#define UTIL_CLAMP_BUCKET_DELTA	DIV_ROUND_UP(SCHED_LOAD_SCALE, UTIL_CLAMP_BUCKETS)
+
+enum util_clamp_id {
+	UTIL_CLAMP_MIN = 0,
+	UTIL_CLAMP_MAX,
+	UTIL_CLAMP_CNT,
+};
+
+struct util_clamp_buckets {
+	/* Bitmap of buckets with RUNNABLE tasks */
+	unsigned long active;
+	/* Count of RUNNABLE tasks refcounting each bucket */
+	unsigned tasks[UTIL_CLAMP_BUCKETS];
+	/* Max clamp value refcounted by each bucket since it became active */
+	unsigned value[UTIL_CLAMP_BUCKETS];
+};
+
 /* SchdTune tunables for a group of tasks */
 struct schedtune {
 	/* SchedTune CGroup subsystem */
@@ -191,6 +260,9 @@ struct schedtune {
 
 	/* Performance Constraint (C) region threshold params */
 	int perf_constrain_idx;
+
+	/* Utilization clamps for tasks on that SchedTune CGroup */
+	unsigned util_clamp[UTIL_CLAMP_CNT];
 };
 
 static inline struct schedtune *css_st(struct cgroup_subsys_state *css)
@@ -228,6 +300,7 @@ root_schedtune = {
 	.boost			= 0,
 	.perf_boost_idx 	= 0,
 	.perf_constrain_idx 	= 0,
+	.util_clamp		= { 0, SCHED_LOAD_SCALE },
 };
 
 int
@@ -298,12 +371,107 @@ struct boost_groups {
 		unsigned boost;
 		/* Count of RUNNABLE tasks on that boost group */
 		unsigned tasks;
+		/* The utilization clamps for tasks on that boost group */
+		unsigned util_clamp[UTIL_CLAMP_CNT];
 	} group[BOOSTGROUPS_COUNT];
+	/* Utilization clamps of all RUNNABLE tasks on a CPU */
+	struct util_clamp_buckets clamp[UTIL_CLAMP_CNT];
 };
 
 /* Boost groups affecting each CPU in the system */
 DEFINE_PER_CPU(struct boost_groups, cpu_boost_groups);
 
+static inline unsigned
+util_clamp_bucket_id(unsigned value)
+{
+	return min_t(unsigned, value / UTIL_CLAMP_BUCKET_DELTA,
+			UTIL_CLAMP_BUCKETS - 1);
+}
+
+static void
+util_clamp_bucket_inc(struct util_clamp_buckets *cb, unsigned value,
+		unsigned tasks)
+{
+	unsigned id = util_clamp_bucket_id(value);
+
+	if (!tasks)
+		return;
+
+	if (!cb->tasks[id]) {
+		cb->value[id] = value;
+		__set_bit(id, &cb->active);
+	} else {
+		cb->value[id] = max(cb->value[id], value);
+	}
+	cb->tasks[id] += tasks;
+}
+
+static void
+util_clamp_bucket_dec(struct util_clamp_buckets *cb, unsigned value,
+		unsigned tasks)
+{
+	unsigned id = util_clamp_bucket_id(value);
+
+	/* Avoid making the bucket count negative, as for boost groups */
+	cb->tasks[id] -= min(cb->tasks[id], tasks);
+	if (!cb->tasks[id]) {
+		cb->value[id] = 0;
+		__clear_bit(id, &cb->active);
+	}
+}
+
+/*
+ * Recompute the value of a bucket from the boost groups still refcounting
+ * it, so that lowering a clamp is not hidden behind its old, higher value.
+ */
+static void
+util_clamp_bucket_refresh(struct boost_groups *bg, int clamp_id, unsigned id)
+{
+	struct util_clamp_buckets *cb = &bg->clamp[clamp_id];
+	unsigned value = 0;
+	int idx;
+
+	if (!cb->tasks[id])
+		return;
+
+	for (idx = 0; idx < BOOSTGROUPS_COUNT; ++idx) {
+		unsigned group_value = bg->group[idx].util_clamp[clamp_id];
+
+		if (!bg->group[idx].tasks ||
+		    util_clamp_bucket_id(group_value) != id)
+			continue;
+		value = max(value, group_value);
+	}
+	cb->value[id] = value;
+}
+
+static inline unsigned
+util_clamp_cpu_value(struct boost_groups *bg, int clamp_id)
+{
+	struct util_clamp_buckets *cb = &bg->clamp[clamp_id];
+
+	if (!cb->active)
+		return clamp_id == UTIL_CLAMP_MIN ? 0 : SCHED_LOAD_SCALE;
+
+	return cb->value[__fls(cb->active)];
+}
+
+static void
+util_clamp_tasks_update(struct boost_groups *bg, int idx, int task_count)
+{
+	int clamp_id;
+
+	for (clamp_id = 0; clamp_id < UTIL_CLAMP_CNT; ++clamp_id) {
+		struct util_clamp_buckets *cb = &bg->clamp[clamp_id];
+		unsigned value = bg->group[idx].util_clamp[clamp_id];
+
+		if (task_count > 0)
+			util_clamp_bucket_inc(cb, value, task_count);
+		else
+			util_clamp_bucket_dec(cb, value, -task_count);
+	}
+}
+
 static void
 schedtune_cpu_update(int cpu)
 {
@@ -382,6 +550,8 @@ schedtune_idle(int cpu)
 	if (!bg->idle) {
 		bg->idle = true;
 		for (idx = 1; idx < BOOSTGROUPS_COUNT; ++idx) {
+			util_clamp_tasks_update(bg, idx,
+					-(int)bg->group[idx].tasks);
 			bg->group[idx].tasks = 0;
 		}
 	}
@@ -398,9 +568,10 @@ schedtune_tasks_update(struct task_struct *p, int cpu, int idx, int task_count)
 
 	/* Update boosted tasks count while avoiding to make it negative */
 	if (task_count < 0 && bg->group[idx].tasks <= -task_count)
-		bg->group[idx].tasks = 0;
-	else
-		bg->group[idx].tasks += task_count;
+		task_count = -(int)bg->group[idx].tasks;
+	bg->group[idx].tasks += task_count;
+
+	util_clamp_tasks_update(bg, idx, task_count);
 
 	/* Boost group activation or deactivation on that RQ */
 	tasks = bg->group[idx].tasks;
@@ -484,6 +655,66 @@ int schedtune_cpu_boost(int cpu)
 	return 	bg->boost_max;
 }
 
+/*
+ * Clamp the utilization of a task to the util.min and util.max of its
+ * boost group.
+ */
+unsigned long schedtune_task_util_clamp(struct task_struct *p,
+		unsigned long util)
+{
+	struct schedtune *st;
+	unsigned util_min, util_max;
+
+	rcu_read_lock();
+	st = task_schedtune(p);
+	util_min = st->util_clamp[UTIL_CLAMP_MIN];
+	util_max = st->util_clamp[UTIL_CLAMP_MAX];
+	rcu_read_unlock();
+
+	return clamp_t(unsigned long, util, util_min, util_max);
+}
+
+/*
+ * Clamp a capacity request of a CPU to the util.min and util.max of the
+ * boost groups with RUNNABLE tasks on it.
+ * NOTE: This function must be called while holding the lock on the CPU RQ
+ */
+unsigned long schedtune_cpu_util_clamp(int cpu, unsigned long util)
+{
+	struct boost_groups *bg = &per_cpu(cpu_boost_groups, cpu);
+
+	return clamp_t(unsigned long, util,
+			util_clamp_cpu_value(bg, UTIL_CLAMP_MIN),
+			util_clamp_cpu_value(bg, UTIL_CLAMP_MAX));
+}
+
+static void
+schedtune_clampgroup_update(int idx, int clamp_id, unsigned value)
+{
+	struct boost_groups *bg;
+	unsigned long flags;
+	int cpu;
+
+	/* Move the RUNNABLE tasks of this group to the new bucket */
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		unsigned tasks, old_value;
+
+		bg = &per_cpu(cpu_boost_groups, cpu);
+
+		raw_spin_lock_irqsave(&rq->lock, flags);
+		tasks = bg->group[idx].tasks;
+		old_value = bg->group[idx].util_clamp[clamp_id];
+		util_clamp_bucket_dec(&bg->clamp[clamp_id], old_value, tasks);
+		bg->group[idx].util_clamp[clamp_id] = value;
+		util_clamp_bucket_inc(&bg->clamp[clamp_id], value, tasks);
+		if (tasks)
+			util_clamp_bucket_refresh(bg, clamp_id,
+					util_clamp_bucket_id(old_value));
+		raw_spin_unlock_irqrestore(&rq->lock, flags);
+	}
+}
+
 static u64
 boost_read(struct cgroup *cgrp, struct cftype *cft)
 {
@@ -529,12 +760,80 @@ out:
 	return err;
 }
 
+/* Serializes the util.min <= util.max check with the clamp update */
+static DEFINE_MUTEX(util_clamp_mutex);
+
+static u64
+util_min_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct schedtune *st = cgroup_st(cgrp);
+	return st->util_clamp[UTIL_CLAMP_MIN];
+}
+
+static int
+util_min_write(struct cgroup *cgrp, struct cftype *cft,
+			  u64 util_min)
+{
+	struct schedtune *st = cgroup_st(cgrp);
+	int err = 0;
+
+	mutex_lock(&util_clamp_mutex);
+	if (util_min > st->util_clamp[UTIL_CLAMP_MAX]) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	st->util_clamp[UTIL_CLAMP_MIN] = util_min;
+	schedtune_clampgroup_update(st->idx, UTIL_CLAMP_MIN, util_min);
+out:
+	mutex_unlock(&util_clamp_mutex);
+	return err;
+}
+
+static u64
+util_max_read(struct cgroup *cgrp, struct cftype *cft)
+{
+	struct schedtune *st = cgroup_st(cgrp);
+	return st->util_clamp[UTIL_CLAMP_MAX];
+}
+
+static int
+util_max_write(struct cgroup *cgrp, struct cftype *cft,
+			  u64 util_max)
+{
+	struct schedtune *st = cgroup_st(cgrp);
+	int err = 0;
+
+	mutex_lock(&util_clamp_mutex);
+	if (util_max > SCHED_LOAD_SCALE ||
+	    util_max < st->util_clamp[UTIL_CLAMP_MIN]) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	st->util_clamp[UTIL_CLAMP_MAX] = util_max;
+	schedtune_clampgroup_update(st->idx, UTIL_CLAMP_MAX, util_max);
+out:
+	mutex_unlock(&util_clamp_mutex);
+	return err;
+}
+
 static struct cftype files[] = {
 	{
 		.name = "boost",
 		.read_u64 = boost_read,
 		.write_u64 = boost_write,
 	},
+	{
+		.name = "util.min",
+		.read_u64 = util_min_read,
+		.write_u64 = util_min_write,
+	},
+	{
+		.name = "util.max",
+		.read_u64 = util_max_read,
+		.write_u64 = util_max_write,
+	},
 	{ }	/* terminate */
 };
 
@@ -552,6 +851,10 @@ schedtune_boostgroup_init(struct schedtune *st)
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		bg->group[st->idx].boost = 0;
 		bg->group[st->idx].tasks = 0;
+		bg->group[st->idx].util_clamp[UTIL_CLAMP_MIN] =
+			st->util_clamp[UTIL_CLAMP_MIN];
+		bg->group[st->idx].util_clamp[UTIL_CLAMP_MAX] =
+			st->util_clamp[UTIL_CLAMP_MAX];
 	}
 
 	return 0;
@@ -567,6 +870,7 @@ schedtune_init(void)
 	for_each_possible_cpu(cpu) {
 		bg = &per_cpu(cpu_boost_groups, cpu);
 		memset(bg, 0 , sizeof(struct boost_groups));
+		bg->group[0].util_clamp[UTIL_CLAMP_MAX] = SCHED_LOAD_SCALE;
 	}
 
 	pr_info("  schedtune configured to support %d boost groups\n",
@@ -608,6 +912,7 @@ schedtune_css_alloc(struct cgroup *cgrp)
 
 	/* Initialize per CPUs boost group support */
 	st->idx = idx;
+	st->util_clamp[UTIL_CLAMP_MAX] = SCHED_LOAD_SCALE;
 	if (schedtune_boostgroup_init(st))
 		goto release;
 
@@ -624,6 +929,8 @@ schedtune_boostgroup_release(struct schedtune *st)
 {
 	/* Reset this group boost */
 	schedtune_boostgroup_update(st->idx, 0);
+	schedtune_clampgroup_update(st->idx, UTIL_CLAMP_MIN, 0);
+	schedtune_clampgroup_update(st->idx, UTIL_CLAMP_MAX, SCHED_LOAD_SCALE);
 
 	/* Keep track of allocated boost group */
 	allocated_group[st->idx] = NULL;
@@ -9,6 +9,10 @@ extern int schedtune_taskgroup_boost(struct task_struct *tsk);
 extern int schedtune_cpu_boost(int cpu);
 extern void schedtune_idle(int cpu);
 
+extern unsigned long schedtune_task_util_clamp(struct task_struct *tsk,
+		unsigned long util);
+extern unsigned long schedtune_cpu_util_clamp(int cpu, unsigned long util);
+
 extern void schedtune_enqueue_task(struct task_struct *p, int cpu);
 extern void schedtune_dequeue_task(struct task_struct *p, int cpu);
 
@@ -22,6 +26,9 @@ extern int schedtune_accept_deltas(int nrg_delta, int cap_delta);
 #define schedtune_enqueue_task(task, cpu) while(0){}
 #define schedtune_dequeue_task(task, cpu) while(0){}
 
+#define schedtune_task_util_clamp(task, util) (util)
+#define schedtune_cpu_util_clamp(cpu, util) (util)
+
 #endif /* CONFIG_CGROUP_SCHEDTUNE */
 
 #else /* CONFIG_SCHED_TUNE */
@@ -32,4 +39,7 @@ extern int schedtune_accept_deltas(int nrg_delta, int cap_delta);
 #define schedtune_enqueue_task(task, cpu) while(0){}
 #define schedtune_dequeue_task(task, cpu) while(0){}
 
+#define schedtune_task_util_clamp(task, util) (util)
+#define schedtune_cpu_util_clamp(cpu, util) (util)
+
 #endif /* CONFIG_SCHED_TUNE */
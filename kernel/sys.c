@@ -2436,6 +2436,26 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 	case PR_SET_VMA:
 		error = prctl_set_vma(arg2, arg3, arg4, arg5);
 		break;
+	case PR_SET_FRAME_HINT:
+		if (arg4 || arg5)
+			return -EINVAL;
+		if (!arg3 || task_pid_vnr(current) == (pid_t)arg3) {
+			error = sched_set_frame_hint(me, arg2);
+			break;
+		}
+		if (!capable(CAP_SYS_NICE))
+			return -EPERM;
+		rcu_read_lock();
+		tsk = find_task_by_vpid((pid_t)arg3);
+		if (tsk == NULL) {
+			rcu_read_unlock();
+			return -ESRCH;
+		}
+		get_task_struct(tsk);
+		rcu_read_unlock();
+		error = sched_set_frame_hint(tsk, arg2);
+		put_task_struct(tsk);
+		break;
 	default:
 		error = -EINVAL;
 		break;
@@ -103,6 +103,11 @@ extern bool zone_reclaimable(struct zone *zone);
  */
 extern pmd_t *mm_find_pmd(struct mm_struct *mm, unsigned long address);
 
+void unmap_page_range(struct mmu_gather *tlb,
+			     struct vm_area_struct *vma,
+			     unsigned long addr, unsigned long end,
+			     struct zap_details *details);
+
 /*
  * in mm/page_alloc.c
  */
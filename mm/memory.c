@@ -61,6 +61,7 @@
 #include <linux/migrate.h>
 #include <linux/string.h>
 #include <linux/bug.h>
+#include <linux/psi.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -1294,7 +1295,7 @@ static inline unsigned long zap_pud_range(struct mmu_gather *tlb,
 	return addr;
 }
 
-static void unmap_page_range(struct mmu_gather *tlb,
+void unmap_page_range(struct mmu_gather *tlb,
 			     struct vm_area_struct *vma,
 			     unsigned long addr, unsigned long end,
 			     struct zap_details *details)
@@ -3041,6 +3042,7 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	pte_t pte;
 	int locked;
 	struct mem_cgroup *ptr;
+	unsigned long pflags;
 	int exclusive = 0;
 	int ret = 0;
 
@@ -3072,6 +3074,7 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	delayacct_set_flag(DELAYACCT_PF_SWAPIN);
 	page = lookup_swap_cache(entry);
 	if (!page) {
+		psi_memstall_enter(&pflags);
 		page = swapin_readahead(entry,
 					GFP_HIGHUSER_MOVABLE, vma, address);
 		if (!page) {
@@ -3083,6 +3086,7 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			if (likely(pte_same(*page_table, orig_pte)))
 				ret = VM_FAULT_OOM;
 			delayacct_clear_flag(DELAYACCT_PF_SWAPIN);
+			psi_memstall_leave(&pflags);
 			goto unlock;
 		}
 
@@ -3105,6 +3109,9 @@ static int do_swap_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	locked = lock_page_or_retry(page, mm, flags);
 
 	delayacct_clear_flag(DELAYACCT_PF_SWAPIN);
+	/* Only a swap cache miss went through the stall section */
+	if (ret & VM_FAULT_MAJOR)
+		psi_memstall_leave(&pflags);
 	if (!locked) {
 		ret |= VM_FAULT_RETRY;
 		goto out_release;
@@ -35,6 +35,12 @@
 #include <linux/freezer.h>
 #include <linux/ftrace.h>
 #include <linux/ratelimit.h>
+#include <linux/kthread.h>
+#include <linux/mmu_notifier.h>
+#include <linux/init.h>
+
+#include <asm/tlb.h>
+#include "internal.h"
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/oom.h>
@@ -556,11 +562,207 @@ void oom_kill_process(struct task_struct *p, gfp_t gfp_mask, int order,
 			  victim_points,
 			  victim_rss,
 			  gfp_mask);
+	wake_oom_reaper(victim);
 
 	put_task_struct(victim);
 }
 #undef K
 
+#ifdef CONFIG_MMU
+/*
+ * The oom reaper tears down the private memory of a killed process right
+ * away instead of waiting for the victim to get scheduled and exit, which
+ * may take long if it is blocked in the kernel or runs on a slow core.
+ * Only private, non-mlocked mappings are unmapped; pages a dying process
+ * faults back in are freed at exit as usual.
+ */
+#define MAX_OOM_REAP_RETRIES 10
+
+static struct task_struct *oom_reaper_th;
+static DECLARE_WAIT_QUEUE_HEAD(oom_reaper_wait);
+static struct task_struct *oom_reaper_list;
+static DEFINE_SPINLOCK(oom_reaper_lock);
+
+static bool process_shares_mm(struct task_struct *p, struct mm_struct *mm)
+{
+	struct task_struct *t;
+
+	for_each_thread(p, t) {
+		struct mm_struct *t_mm = ACCESS_ONCE(t->mm);
+
+		if (t_mm)
+			return t_mm == mm;
+	}
+	return false;
+}
+
+/*
+ * The address space may only be reaped if every process sharing it is
+ * going away as well; a vfork parent must not lose its memory because
+ * the child was killed.
+ */
+static bool mm_reapable(struct task_struct *tsk, struct mm_struct *mm)
+{
+	struct task_struct *p;
+	bool ret = true;
+
+	/* one reference is ours */
+	if (atomic_read(&mm->mm_users) <= get_nr_threads(tsk) + 1)
+		return true;
+
+	rcu_read_lock();
+	for_each_process(p) {
+		if (same_thread_group(p, tsk) || !process_shares_mm(p, mm))
+			continue;
+		if ((p->flags & PF_KTHREAD) || !fatal_signal_pending(p)) {
+			ret = false;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+/* Returns false if the reaping should be retried later */
+static bool __oom_reap_task(struct task_struct *tsk)
+{
+	struct mmu_gather tlb;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	struct task_struct *p;
+	unsigned long rss;
+	bool ret = true;
+
+	p = find_lock_task_mm(tsk);
+	if (!p)
+		return true;
+
+	/* Pin mm_users so that exit_mmap() cannot run under us */
+	mm = p->mm;
+	if (!atomic_inc_not_zero(&mm->mm_users)) {
+		task_unlock(p);
+		return true;
+	}
+	task_unlock(p);
+
+	if (!mm_reapable(tsk, mm)) {
+		trace_skip_task_reaping(tsk->pid);
+		goto out_mm;
+	}
+
+	if (!down_read_trylock(&mm->mmap_sem)) {
+		ret = false;
+		goto out_mm;
+	}
+
+	trace_start_task_reaping(tsk->pid);
+	rss = get_mm_rss(mm);
+	for (vma = mm->mmap; vma; vma = vma->vm_next) {
+		if (vma->vm_flags &
+		    (VM_SHARED | VM_LOCKED | VM_HUGETLB | VM_PFNMAP))
+			continue;
+
+		mmu_notifier_invalidate_range_start(mm, vma->vm_start,
+						    vma->vm_end);
+		tlb_gather_mmu(&tlb, mm, vma->vm_start, vma->vm_end);
+		unmap_page_range(&tlb, vma, vma->vm_start, vma->vm_end, NULL);
+		tlb_finish_mmu(&tlb, vma->vm_start, vma->vm_end);
+		mmu_notifier_invalidate_range_end(mm, vma->vm_start,
+						  vma->vm_end);
+	}
+	trace_finish_task_reaping(tsk->pid, rss, get_mm_rss(mm),
+				  local_clock() - tsk->oom_reap_queued);
+	pr_info("oom_reaper: reaped process %d (%s), now anon-rss:%lukB, file-rss:%lukB\n",
+		task_pid_nr(tsk), tsk->comm,
+		get_mm_counter(mm, MM_ANONPAGES) << (PAGE_SHIFT - 10),
+		get_mm_counter(mm, MM_FILEPAGES) << (PAGE_SHIFT - 10));
+	up_read(&mm->mmap_sem);
+out_mm:
+	/* This may be the last reference and run exit_mmap() right here */
+	mmput(mm);
+	return ret;
+}
+
+static void oom_reap_task(struct task_struct *tsk)
+{
+	int attempts = 0;
+
+	/* Retry the mmap_sem read trylock a few times */
+	while (attempts++ < MAX_OOM_REAP_RETRIES && !__oom_reap_task(tsk))
+		schedule_timeout_interruptible(HZ / 10);
+
+	if (attempts > MAX_OOM_REAP_RETRIES)
+		pr_info("oom_reaper: unable to reap pid:%d (%s)\n",
+			task_pid_nr(tsk), tsk->comm);
+
+	spin_lock(&oom_reaper_lock);
+	tsk->oom_reap_queued = 0;
+	spin_unlock(&oom_reaper_lock);
+	put_task_struct(tsk);
+}
+
+static int oom_reaper(void *unused)
+{
+	set_freezable();
+
+	while (true) {
+		struct task_struct *tsk = NULL;
+
+		wait_event_freezable(oom_reaper_wait, oom_reaper_list != NULL);
+		spin_lock(&oom_reaper_lock);
+		if (oom_reaper_list != NULL) {
+			tsk = oom_reaper_list;
+			oom_reaper_list = tsk->oom_reaper_list;
+		}
+		spin_unlock(&oom_reaper_lock);
+
+		if (tsk)
+			oom_reap_task(tsk);
+	}
+
+	return 0;
+}
+
+/**
+ * wake_oom_reaper - queue a killed task for reaping
+ * @tsk: task that has just been sent SIGKILL
+ *
+ * Used by the OOM killer and the Android lowmemorykiller.
+ */
+void wake_oom_reaper(struct task_struct *tsk)
+{
+	if (!oom_reaper_th)
+		return;
+
+	spin_lock(&oom_reaper_lock);
+	/* already queued or being reaped */
+	if (tsk->oom_reap_queued) {
+		spin_unlock(&oom_reaper_lock);
+		return;
+	}
+	get_task_struct(tsk);
+	tsk->oom_reap_queued = local_clock();
+	tsk->oom_reaper_list = oom_reaper_list;
+	oom_reaper_list = tsk;
+	spin_unlock(&oom_reaper_lock);
+	trace_wake_reaper(tsk->pid);
+	wake_up(&oom_reaper_wait);
+}
+
+static int __init oom_init(void)
+{
+	oom_reaper_th = kthread_run(oom_reaper, NULL, "oom_reaper");
+	if (IS_ERR(oom_reaper_th)) {
+		pr_err("Unable to start OOM reaper %ld. Continuing regardless\n",
+		       PTR_ERR(oom_reaper_th));
+		oom_reaper_th = NULL;
+	}
+	return 0;
+}
+subsys_initcall(oom_init);
+#endif /* CONFIG_MMU */
+
 /*
  * Determines whether the kernel must panic because of the panic_on_oom sysctl.
  */
@@ -126,6 +126,34 @@ static void zpool_put_driver(struct zpool_driver *driver)
 	module_put(driver->owner);
 }
 
+/**
+ * zpool_has_pool() - Check if the pool driver is available
+ * @type	The type of the zpool to check (e.g. zbud, zsmalloc)
+ *
+ * This checks if the @type pool driver is available, loading the
+ * zpool-@type module if needed.  There is no guarantee the driver is still
+ * around when zpool_create_pool() is called afterwards, so callers must
+ * still handle that failing; a false return however means creating a pool
+ * of this type is certain to fail.
+ *
+ * Returns: true if @type pool is available, false if not
+ */
+bool zpool_has_pool(char *type)
+{
+	struct zpool_driver *driver = zpool_get_driver(type);
+
+	if (!driver) {
+		request_module("zpool-%s", type);
+		driver = zpool_get_driver(type);
+	}
+
+	if (!driver)
+		return false;
+
+	zpool_put_driver(driver);
+	return true;
+}
+
 /**
  * zpool_create_pool() - Create a new zpool
  * @type	The type of the zpool to create (e.g. zbud, zsmalloc)
@@ -361,6 +389,21 @@ unsigned long zpool_compact(struct zpool *zpool)
 		zpool->driver->compact(zpool->pool) : 0;
 }
 
+/**
+ * zpool_get_compacted_pages() - pages released by pool compaction
+ * @pool	The zpool to check
+ *
+ * This includes compaction the backend ran on its own, not only
+ * zpool_compact() calls.
+ *
+ * Returns: Number of pages freed by compaction so far
+ */
+unsigned long zpool_get_compacted_pages(struct zpool *zpool)
+{
+	return zpool->driver->compacted_pages ?
+		zpool->driver->compacted_pages(zpool->pool) : 0;
+}
+
 static int __init init_zpool(void)
 {
 	pr_info("loaded\n");
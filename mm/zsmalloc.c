@@ -69,6 +69,8 @@
 #include <linux/debugfs.h>
 #include <linux/zsmalloc.h>
 #include <linux/zpool.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 
 /*
  * This must be power of 2 and greater than of equal to sizeof(link_free).
@@ -154,6 +156,15 @@
  */
 #define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
 
+/*
+ * Every non-huge size class keeps a small per-cpu magazine of object slots
+ * taken off its zspages, so that most zs_malloc()/zs_free() calls only
+ * touch the local magazine lock instead of the shared class lock. Slots
+ * move between a magazine and the zspages ZS_MAG_BATCH at a time.
+ */
+#define ZS_MAG_SIZE		16
+#define ZS_MAG_BATCH		(ZS_MAG_SIZE / 2)
+
 /*
  * We do not maintain any list for completely empty or full pages
  */
@@ -174,15 +185,42 @@ enum zs_stat_type {
 	NR_ZS_STAT_TYPE,
 };
 
-#ifdef CONFIG_ZSMALLOC_STAT
-
-static struct dentry *zs_stat_root;
-
+/* also read by background compaction, so kept without ZSMALLOC_STAT */
 struct zs_size_stat {
 	unsigned long objs[NR_ZS_STAT_TYPE];
 };
 
+#ifdef CONFIG_ZSMALLOC_STAT
+static struct dentry *zs_stat_root;
+#endif
+
+/*
+ * Background compaction: each pool has a kthread which is woken from
+ * zs_free() once a class has at least a zspage worth of free slots and
+ * less than zs_compact_ratio percent of its slots in use. It compacts at
+ * most zs_compact_batch source zspages per class at a time, rescheduling
+ * in between. A zero ratio turns it off.
+ */
+static unsigned int zs_compact_ratio = 70;
+module_param_named(compact_ratio, zs_compact_ratio, uint, 0644);
+
+static unsigned int zs_compact_batch = 16;
+module_param_named(compact_batch, zs_compact_batch, uint, 0644);
+
+/*
+ * Object slots reserved from a size class for one cpu. Reserved slots are
+ * counted as used by their zspage but carry no OBJ_ALLOCATED_TAG, so
+ * compaction leaves them alone. Lock order is magazine, then class.
+ */
+struct zs_magazine {
+	spinlock_t lock;
+	unsigned int nr;
+	unsigned long objs[ZS_MAG_SIZE];
+#ifdef CONFIG_ZSMALLOC_STAT
+	unsigned long hit;
+	unsigned long miss;
 #endif
+};
 
 /*
  * number of size_classes
@@ -218,13 +256,16 @@ struct size_class {
 	/* huge object: pages_per_zspage == 1 && maxobj_per_zspage == 1 */
 	bool huge;
 
-#ifdef CONFIG_ZSMALLOC_STAT
 	struct zs_size_stat stats;
-#endif
 
 	spinlock_t lock;
 
 	struct page *fullness_list[_ZS_NR_FULLNESS_GROUPS];
+
+	/* per-cpu slot caches, NULL for huge classes */
+	struct zs_magazine __percpu *mag;
+	/* magazines are bypassed while non-zero, see zs_mag_drain() */
+	atomic_t compacting;
 };
 
 /*
@@ -255,6 +296,12 @@ struct zs_pool {
 
 	gfp_t flags;	/* allocation flags used when growing pool */
 	atomic_long_t pages_allocated;
+	/* zspage pages released by compaction */
+	atomic_long_t pages_compacted;
+
+	struct task_struct *compactd;
+	wait_queue_head_t compact_wait;
+	bool compact_pending;
 
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
@@ -376,6 +423,11 @@ static unsigned long zs_zpool_compact(void *pool)
 	return zs_compact(pool);
 }
 
+static unsigned long zs_zpool_compacted_pages(void *pool)
+{
+	return zs_get_compacted_pages(pool);
+}
+
 static struct zpool_driver zs_zpool_driver = {
 	.type =		"zsmalloc",
 	.owner =	THIS_MODULE,
@@ -388,6 +440,7 @@ static struct zpool_driver zs_zpool_driver = {
 	.unmap =	zs_zpool_unmap,
 	.total_size =	zs_zpool_total_size,
 	.compact =	zs_zpool_compact,
+	.compacted_pages = zs_zpool_compacted_pages,
 };
 
 MODULE_ALIAS("zpool-zsmalloc");
@@ -451,8 +504,6 @@ static int get_size_class_index(int size)
 	return min(zs_size_classes - 1, idx);
 }
 
-#ifdef CONFIG_ZSMALLOC_STAT
-
 static inline void zs_stat_inc(struct size_class *class,
 				enum zs_stat_type type, unsigned long cnt)
 {
@@ -471,6 +522,8 @@ static inline unsigned long zs_stat_get(struct size_class *class,
 	return class->stats.objs[type];
 }
 
+#ifdef CONFIG_ZSMALLOC_STAT
+
 static int __init zs_stat_init(void)
 {
 	if (!debugfs_initialized())
@@ -488,6 +541,23 @@ static void __exit zs_stat_exit(void)
 	debugfs_remove_recursive(zs_stat_root);
 }
 
+static void zs_mag_stat_get(struct size_class *class, unsigned long *hit,
+				unsigned long *miss)
+{
+	struct zs_magazine *mag;
+	int cpu;
+
+	*hit = *miss = 0;
+	if (!class->mag)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		mag = per_cpu_ptr(class->mag, cpu);
+		*hit += mag->hit;
+		*miss += mag->miss;
+	}
+}
+
 static int zs_stats_size_show(struct seq_file *s, void *v)
 {
 	int i;
@@ -496,13 +566,15 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 	int objs_per_zspage;
 	unsigned long class_almost_full, class_almost_empty;
 	unsigned long obj_allocated, obj_used, pages_used;
+	unsigned long mag_hit, mag_miss;
 	unsigned long total_class_almost_full = 0, total_class_almost_empty = 0;
 	unsigned long total_objs = 0, total_used_objs = 0, total_pages = 0;
+	unsigned long total_mag_hit = 0, total_mag_miss = 0;
 
-	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s\n",
+	seq_printf(s, " %5s %5s %11s %12s %13s %10s %10s %16s %10s %10s\n",
 			"class", "size", "almost_full", "almost_empty",
 			"obj_allocated", "obj_used", "pages_used",
-			"pages_per_zspage");
+			"pages_per_zspage", "mag_hit", "mag_miss");
 
 	for (i = 0; i < zs_size_classes; i++) {
 		class = pool->size_class[i];
@@ -517,28 +589,33 @@ static int zs_stats_size_show(struct seq_file *s, void *v)
 		obj_used = zs_stat_get(class, OBJ_USED);
 		spin_unlock(&class->lock);
 
+		zs_mag_stat_get(class, &mag_hit, &mag_miss);
+
 		objs_per_zspage = get_maxobj_per_zspage(class->size,
 				class->pages_per_zspage);
 		pages_used = obj_allocated / objs_per_zspage *
 				class->pages_per_zspage;
 
-		seq_printf(s, " %5u %5u %11lu %12lu %13lu %10lu %10lu %16d\n",
+		seq_printf(s, " %5u %5u %11lu %12lu %13lu %10lu %10lu %16d %10lu %10lu\n",
 			i, class->size, class_almost_full, class_almost_empty,
 			obj_allocated, obj_used, pages_used,
-			class->pages_per_zspage);
+			class->pages_per_zspage, mag_hit, mag_miss);
 
 		total_class_almost_full += class_almost_full;
 		total_class_almost_empty += class_almost_empty;
 		total_objs += obj_allocated;
 		total_used_objs += obj_used;
 		total_pages += pages_used;
+		total_mag_hit += mag_hit;
+		total_mag_miss += mag_miss;
 	}
 
 	seq_puts(s, "\n");
-	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu\n",
+	seq_printf(s, " %5s %5s %11lu %12lu %13lu %10lu %10lu %16s %10lu %10lu\n",
 			"Total", "", total_class_almost_full,
 			total_class_almost_empty, total_objs,
-			total_used_objs, total_pages);
+			total_used_objs, total_pages, "",
+			total_mag_hit, total_mag_miss);
 
 	return 0;
 }
@@ -585,23 +662,17 @@ static void zs_pool_stat_destroy(struct zs_pool *pool)
 	debugfs_remove_recursive(pool->stat_dentry);
 }
 
-#else /* CONFIG_ZSMALLOC_STAT */
-
-static inline void zs_stat_inc(struct size_class *class,
-				enum zs_stat_type type, unsigned long cnt)
+static inline void zs_mag_hit(struct zs_magazine *mag)
 {
+	mag->hit++;
 }
 
-static inline void zs_stat_dec(struct size_class *class,
-				enum zs_stat_type type, unsigned long cnt)
+static inline void zs_mag_miss(struct zs_magazine *mag)
 {
+	mag->miss++;
 }
 
-static inline unsigned long zs_stat_get(struct size_class *class,
-				enum zs_stat_type type)
-{
-	return 0;
-}
+#else /* CONFIG_ZSMALLOC_STAT */
 
 static int __init zs_stat_init(void)
 {
@@ -621,6 +692,14 @@ static inline void zs_pool_stat_destroy(struct zs_pool *pool)
 {
 }
 
+static inline void zs_mag_hit(struct zs_magazine *mag)
+{
+}
+
+static inline void zs_mag_miss(struct zs_magazine *mag)
+{
+}
+
 #endif
 
 
@@ -1246,6 +1325,19 @@ unsigned long zs_get_total_pages(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_get_total_pages);
 
+/**
+ * zs_get_compacted_pages - pages released by compaction
+ * @pool: pool to query
+ *
+ * Counts both zs_compact() calls and background compaction over the
+ * lifetime of the pool.
+ */
+unsigned long zs_get_compacted_pages(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
+EXPORT_SYMBOL_GPL(zs_get_compacted_pages);
+
 /**
  * zs_map_object - get address of allocated object from handle.
  * @pool: pool from which the object was allocated
@@ -1359,7 +1451,9 @@ static unsigned long obj_malloc(struct page *first_page,
 	unsigned long m_objidx, m_offset;
 	void *vaddr;
 
-	handle |= OBJ_ALLOCATED_TAG;
+	/* a zero handle reserves the slot for a magazine */
+	if (handle)
+		handle |= OBJ_ALLOCATED_TAG;
 	obj = (unsigned long)first_page->freelist;
 	obj_to_location(obj, &m_page, &m_objidx);
 	m_offset = obj_idx_to_offset(m_page, m_objidx, class->size);
@@ -1381,6 +1475,231 @@ static unsigned long obj_malloc(struct page *first_page,
 }
 
 
+static void obj_free(struct zs_pool *pool, struct size_class *class,
+			unsigned long obj)
+{
+	struct link_free *link;
+	struct page *first_page, *f_page;
+	unsigned long f_objidx, f_offset;
+	void *vaddr;
+	int class_idx;
+	enum fullness_group fullness;
+
+	BUG_ON(!obj);
+
+	obj &= ~OBJ_ALLOCATED_TAG;
+	obj_to_location(obj, &f_page, &f_objidx);
+	first_page = get_first_page(f_page);
+
+	get_zspage_mapping(first_page, &class_idx, &fullness);
+	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
+
+	vaddr = kmap_atomic(f_page);
+
+	/* Insert this object in containing zspage's freelist */
+	link = (struct link_free *)(vaddr + f_offset);
+	link->next = first_page->freelist;
+	if (class->huge)
+		set_page_private(first_page, 0);
+	kunmap_atomic(vaddr);
+	first_page->freelist = (void *)obj;
+	first_page->inuse--;
+	zs_stat_dec(class, OBJ_USED, 1);
+}
+
+/*
+ * Whether compacting class could give back at least one zspage: it has
+ * almost empty zspages to migrate from and its use ratio dropped below
+ * zs_compact_ratio. Called with class->lock held.
+ */
+static bool zs_class_fragmented(struct size_class *class)
+{
+	unsigned long allocated = zs_stat_get(class, OBJ_ALLOCATED);
+	unsigned long used = zs_stat_get(class, OBJ_USED);
+	unsigned int ratio = ACCESS_ONCE(zs_compact_ratio);
+
+	if (!ratio || !class->fullness_list[ZS_ALMOST_EMPTY])
+		return false;
+
+	if (allocated - used < get_maxobj_per_zspage(class->size,
+					class->pages_per_zspage))
+		return false;
+
+	return used * 100 < allocated * ratio;
+}
+
+static void zs_wake_compactd(struct zs_pool *pool)
+{
+	if (!pool->compactd || ACCESS_ONCE(pool->compact_pending))
+		return;
+
+	pool->compact_pending = true;
+	wake_up(&pool->compact_wait);
+}
+
+/* gives obj back to its zspage, freeing the zspage once empty */
+static void __zs_free(struct zs_pool *pool, struct size_class *class,
+			unsigned long obj)
+{
+	struct page *first_page, *f_page;
+	unsigned long f_objidx;
+	enum fullness_group fullness;
+
+	obj_to_location(obj, &f_page, &f_objidx);
+	first_page = get_first_page(f_page);
+
+	obj_free(pool, class, obj);
+	fullness = fix_fullness_group(class, first_page);
+	if (fullness == ZS_EMPTY) {
+		zs_stat_dec(class, OBJ_ALLOCATED, get_maxobj_per_zspage(
+				class->size, class->pages_per_zspage));
+		atomic_long_sub(class->pages_per_zspage,
+				&pool->pages_allocated);
+		free_zspage(first_page);
+	}
+
+	if (zs_class_fragmented(class))
+		zs_wake_compactd(pool);
+}
+
+/* sets the header word of a non-huge object */
+static void obj_set_head(struct size_class *class, unsigned long obj,
+			unsigned long head)
+{
+	struct link_free *link;
+	struct page *page;
+	unsigned long obj_idx, off;
+	void *vaddr;
+
+	obj_to_location(obj, &page, &obj_idx);
+	off = obj_idx_to_offset(page, obj_idx, class->size);
+
+	vaddr = kmap_atomic(page);
+	link = (struct link_free *)vaddr + off / sizeof(*link);
+	link->handle = head;
+	kunmap_atomic(vaddr);
+}
+
+static struct zs_magazine *zs_mag_lock(struct size_class *class)
+{
+	struct zs_magazine *mag;
+
+	/* any cpu's magazine will do if we get migrated, it has its lock */
+	mag = per_cpu_ptr(class->mag, raw_smp_processor_id());
+	spin_lock(&mag->lock);
+	if (unlikely(atomic_read(&class->compacting))) {
+		spin_unlock(&mag->lock);
+		return NULL;
+	}
+
+	return mag;
+}
+
+/* moves up to ZS_MAG_BATCH free slots of existing zspages into mag */
+static void zs_mag_refill(struct size_class *class, struct zs_magazine *mag)
+{
+	struct page *first_page;
+
+	spin_lock(&class->lock);
+	while (mag->nr < ZS_MAG_BATCH) {
+		first_page = find_get_zspage(class);
+		if (!first_page)
+			break;
+
+		mag->objs[mag->nr++] = obj_malloc(first_page, class, 0);
+		fix_fullness_group(class, first_page);
+	}
+	spin_unlock(&class->lock);
+}
+
+/* gives the nr oldest slots of mag back to their zspages */
+static void zs_mag_flush(struct zs_pool *pool, struct size_class *class,
+			struct zs_magazine *mag, unsigned int nr)
+{
+	unsigned int i;
+
+	spin_lock(&class->lock);
+	for (i = 0; i < nr; i++)
+		__zs_free(pool, class, mag->objs[i]);
+	spin_unlock(&class->lock);
+
+	mag->nr -= nr;
+	memmove(mag->objs, mag->objs + nr, mag->nr * sizeof(mag->objs[0]));
+}
+
+/*
+ * Empties the magazines of every cpu. Callers raise class->compacting
+ * first, so that once this returns no slot sits in a magazine and no
+ * lockless header update is in flight.
+ */
+static void zs_mag_drain(struct zs_pool *pool, struct size_class *class)
+{
+	struct zs_magazine *mag;
+	int cpu;
+
+	if (!class->mag)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		mag = per_cpu_ptr(class->mag, cpu);
+		spin_lock(&mag->lock);
+		if (mag->nr)
+			zs_mag_flush(pool, class, mag, mag->nr);
+		spin_unlock(&mag->lock);
+	}
+}
+
+/*
+ * Takes a slot from the local magazine for handle, refilling it from the
+ * class if empty. Returns 0 when the class has no free slot left.
+ */
+static unsigned long zs_mag_alloc(struct size_class *class,
+				unsigned long handle)
+{
+	struct zs_magazine *mag;
+	unsigned long obj = 0;
+
+	mag = zs_mag_lock(class);
+	if (!mag)
+		return 0;
+
+	if (mag->nr) {
+		zs_mag_hit(mag);
+	} else {
+		zs_mag_miss(mag);
+		zs_mag_refill(class, mag);
+	}
+
+	if (mag->nr) {
+		obj = mag->objs[--mag->nr];
+		record_obj(handle, obj);
+		obj_set_head(class, obj, handle | OBJ_ALLOCATED_TAG);
+	}
+	spin_unlock(&mag->lock);
+
+	return obj;
+}
+
+/* parks the slot of obj in the local magazine, false if bypassed */
+static bool zs_mag_free(struct zs_pool *pool, struct size_class *class,
+			unsigned long obj)
+{
+	struct zs_magazine *mag;
+
+	mag = zs_mag_lock(class);
+	if (!mag)
+		return false;
+
+	if (mag->nr == ZS_MAG_SIZE)
+		zs_mag_flush(pool, class, mag, ZS_MAG_BATCH);
+
+	obj_set_head(class, obj, 0);
+	mag->objs[mag->nr++] = obj;
+	spin_unlock(&mag->lock);
+
+	return true;
+}
+
 /**
  * zs_malloc - Allocate block of given size from pool.
  * @pool: pool to allocate from
@@ -1407,6 +1726,9 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size)
 	size += ZS_HANDLE_SIZE;
 	class = pool->size_class[get_size_class_index(size)];
 
+	if (class->mag && zs_mag_alloc(class, handle))
+		return handle;
+
 	spin_lock(&class->lock);
 	first_page = find_get_zspage(class);
 
@@ -1437,38 +1759,6 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size)
 }
 EXPORT_SYMBOL_GPL(zs_malloc);
 
-static void obj_free(struct zs_pool *pool, struct size_class *class,
-			unsigned long obj)
-{
-	struct link_free *link;
-	struct page *first_page, *f_page;
-	unsigned long f_objidx, f_offset;
-	void *vaddr;
-	int class_idx;
-	enum fullness_group fullness;
-
-	BUG_ON(!obj);
-
-	obj &= ~OBJ_ALLOCATED_TAG;
-	obj_to_location(obj, &f_page, &f_objidx);
-	first_page = get_first_page(f_page);
-
-	get_zspage_mapping(first_page, &class_idx, &fullness);
-	f_offset = obj_idx_to_offset(f_page, f_objidx, class->size);
-
-	vaddr = kmap_atomic(f_page);
-
-	/* Insert this object in containing zspage's freelist */
-	link = (struct link_free *)(vaddr + f_offset);
-	link->next = first_page->freelist;
-	if (class->huge)
-		set_page_private(first_page, 0);
-	kunmap_atomic(vaddr);
-	first_page->freelist = (void *)obj;
-	first_page->inuse--;
-	zs_stat_dec(class, OBJ_USED, 1);
-}
-
 void zs_free(struct zs_pool *pool, unsigned long handle)
 {
 	struct page *first_page, *f_page;
@@ -1488,17 +1778,11 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	get_zspage_mapping(first_page, &class_idx, &fullness);
 	class = pool->size_class[class_idx];
 
-	spin_lock(&class->lock);
-	obj_free(pool, class, obj);
-	fullness = fix_fullness_group(class, first_page);
-	if (fullness == ZS_EMPTY) {
-		zs_stat_dec(class, OBJ_ALLOCATED, get_maxobj_per_zspage(
-				class->size, class->pages_per_zspage));
-		atomic_long_sub(class->pages_per_zspage,
-				&pool->pages_allocated);
-		free_zspage(first_page);
+	if (!class->mag || !zs_mag_free(pool, class, obj)) {
+		spin_lock(&class->lock);
+		__zs_free(pool, class, obj);
+		spin_unlock(&class->lock);
 	}
-	spin_unlock(&class->lock);
 	unpin_tag(handle);
 
 	free_handle(pool, handle);
@@ -1694,6 +1978,8 @@ static void putback_zspage(struct zs_pool *pool, struct size_class *class,
 			class->size, class->pages_per_zspage));
 		atomic_long_sub(class->pages_per_zspage,
 				&pool->pages_allocated);
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_compacted);
 
 		free_zspage(first_page);
 	}
@@ -1710,8 +1996,10 @@ static struct page *isolate_source_page(struct size_class *class)
 	return page;
 }
 
+/* migrates from at most nr_zspages source zspages, 0 means no limit */
 static unsigned long __zs_compact(struct zs_pool *pool,
-				struct size_class *class)
+				struct size_class *class,
+				unsigned int nr_zspages)
 {
 	int nr_to_migrate;
 	struct zs_compact_control cc;
@@ -1749,8 +2037,12 @@ static unsigned long __zs_compact(struct zs_pool *pool,
 
 		putback_zspage(pool, class, dst_page);
 		putback_zspage(pool, class, src_page);
-		spin_unlock(&class->lock);
+		src_page = NULL;
 		nr_total_migrated += cc.nr_migrated;
+		if (nr_zspages && !--nr_zspages)
+			break;
+
+		spin_unlock(&class->lock);
 		cond_resched();
 		spin_lock(&class->lock);
 	}
@@ -1775,13 +2067,72 @@ unsigned long zs_compact(struct zs_pool *pool)
 			continue;
 		if (class->index != i)
 			continue;
-		nr_migrated += __zs_compact(pool, class);
+
+		/* slots parked in magazines would pin their zspages */
+		atomic_inc(&class->compacting);
+		zs_mag_drain(pool, class);
+		nr_migrated += __zs_compact(pool, class, 0);
+		atomic_dec(&class->compacting);
 	}
 
 	return nr_migrated;
 }
 EXPORT_SYMBOL_GPL(zs_compact);
 
+/* one background pass, in zs_compact_batch sized steps per class */
+static void zs_compact_fragmented(struct zs_pool *pool)
+{
+	struct size_class *class;
+	unsigned long nr_migrated;
+	bool fragmented;
+	int i;
+
+	for (i = zs_size_classes - 1; i >= 0; i--) {
+		class = pool->size_class[i];
+		if (!class)
+			continue;
+		if (class->index != i)
+			continue;
+
+		do {
+			if (kthread_should_stop())
+				return;
+
+			spin_lock(&class->lock);
+			fragmented = zs_class_fragmented(class);
+			spin_unlock(&class->lock);
+			if (!fragmented)
+				break;
+
+			atomic_inc(&class->compacting);
+			zs_mag_drain(pool, class);
+			nr_migrated = __zs_compact(pool, class,
+					max(ACCESS_ONCE(zs_compact_batch), 1U));
+			atomic_dec(&class->compacting);
+			cond_resched();
+		} while (nr_migrated);
+	}
+}
+
+static int zs_compactd(void *data)
+{
+	struct zs_pool *pool = data;
+
+	set_freezable();
+	set_user_nice(current, MAX_NICE);
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(pool->compact_wait,
+				ACCESS_ONCE(pool->compact_pending) ||
+				kthread_should_stop());
+
+		pool->compact_pending = false;
+		zs_compact_fragmented(pool);
+	}
+
+	return 0;
+}
+
 /**
  * zs_create_pool - Creates an allocation pool to work from.
  * @flags: allocation flags used to allocate pool metadata
@@ -1860,6 +2211,17 @@ struct zs_pool *zs_create_pool(char *name, gfp_t flags)
 		pool->size_class[i] = class;
 
 		prev_class = class;
+
+		if (!class->huge) {
+			int cpu;
+
+			class->mag = alloc_percpu(struct zs_magazine);
+			if (!class->mag)
+				goto err;
+			for_each_possible_cpu(cpu)
+				spin_lock_init(&per_cpu_ptr(class->mag,
+							cpu)->lock);
+		}
 	}
 
 	pool->flags = flags;
@@ -1867,6 +2229,13 @@ struct zs_pool *zs_create_pool(char *name, gfp_t flags)
 	if (zs_pool_stat_create(name, pool))
 		goto err;
 
+	init_waitqueue_head(&pool->compact_wait);
+	pool->compactd = kthread_run(zs_compactd, pool, "zs_compact/%s", name);
+	if (IS_ERR(pool->compactd)) {
+		pool->compactd = NULL;
+		goto err;
+	}
+
 	return pool;
 
 err:
@@ -1879,6 +2248,11 @@ void zs_destroy_pool(struct zs_pool *pool)
 {
 	int i;
 
+	if (pool->compactd) {
+		kthread_stop(pool->compactd);
+		pool->compactd = NULL;
+	}
+
 	zs_pool_stat_destroy(pool);
 
 	for (i = 0; i < zs_size_classes; i++) {
@@ -1891,6 +2265,12 @@ void zs_destroy_pool(struct zs_pool *pool)
 		if (class->index != i)
 			continue;
 
+		if (class->mag) {
+			atomic_inc(&class->compacting);
+			zs_mag_drain(pool, class);
+			free_percpu(class->mag);
+		}
+
 		for (fg = 0; fg < _ZS_NR_FULLNESS_GROUPS; fg++) {
 			if (class->fullness_list[fg]) {
 				pr_info("Freeing non-empty class with size %db, fullness group %d\n",